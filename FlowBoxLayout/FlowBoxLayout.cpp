@@ -2,551 +2,834 @@
 
 namespace Upp {
 
+FlowBoxLayout::FlowBoxLayout(Direction d) : dir(d) {
+    Transparent();
+    solver.SetPlanCache(4);
 
-FlowBoxLayout& FlowBoxLayout::ClearItems() {
-    for(Ctrl *q = GetFirstChild(); q; ) {
-        Ctrl* next = q->GetNext();
-        q->Remove();
-        q = next;
+    // children that size themselves along the other axis
+    solver.WhenWidthForHeight = [this](int i, int height) {
+        return GetCtrlConstraintSize(i, height, false);
+    };
+    solver.WhenHeightForWidth = [this](int i, int width) {
+        return GetCtrlConstraintSize(i, width, true);
+    };
+
+    ONCELOCK {
+        InstallStateHook(ChildStateHook);
     }
-    items.Clear();
-    used_w = used_h = 0;
-    Layout();
-    return *this;
 }
 
-void FlowBoxLayout::Layout() {
-    if(layout_pause > 0) return;       // ← short-circuit when paused
-    Rect rc = GetSize();
-    if(rc.IsEmpty()) { used_w = used_h = 0; return; }
+void FlowBoxLayout::InsertItem(int at, Ctrl* c, FlowItemSpec s) {
+    at = minmax(at, 0, items.GetCount());
+    if(c) AddChildAt(c, at);
+    SetupItem(items.Insert(at), c, s);
+    ++cur_gen;
+    solver.Insert(at, s);
+    Reindex(at, items.GetCount());
+    ApplyFilter(at, items.GetCount());
+}
 
-    Rect irc = rc;
-    irc.left   += inset.left;
-    irc.top    += inset.top;
-    irc.right  -= inset.right;
-    irc.bottom -= inset.bottom;
-    if(irc.IsEmpty()) { used_w = used_h = 0; return; }
+void FlowBoxLayout::SetupItem(Item& it, Ctrl* c, FlowItemSpec& s) {
+    it.c = c;
+    if(!virtual_mode) {
+        it.slot = AllocSlot();
+        if(c) ctrl_slot.GetPut(c) = it.slot;
+    }
+    // resolved once here, the planning passes only test the spec flag
+    if(FlowBoxLayout* fb = dynamic_cast<FlowBoxLayout*>(c)) {
+        it.sizer  = fb;
+        it.nested = true;
+    }
+    else
+        it.sizer = dynamic_cast<FlowConstraintSize*>(c);
+    s.hfw = it.sizer != nullptr;
+}
 
-    if(plan_inner != irc.GetSize() || plan_gen != cur_gen)
-        PreLayoutCalc(irc);
+void FlowBoxLayout::AddChildAt(Ctrl* c, int at) {
+    Ctrl* next = nullptr;
+    for(int i = at; i < items.GetCount() && !next; ++i)
+        next = items[i].c;
+    if(c->GetParent() == this && c->GetNext() == next)
+        return;                        // already there
+    // re-adding a child takes the focus from it; give it back afterwards
+    Ctrl* focus = c->GetParent() == this && c->HasFocusDeep() ? GetFocusCtrl() : nullptr;
+    if(next)
+        AddChildBefore(c, next);
+    else
+        ParentCtrl::Add(*c);
+    if(focus)
+        focus->SetFocus();
+}
 
-    PostLayoutCommit();
+FlowBoxLayout::ItemRef FlowBoxLayout::Insert(int at, Ctrl& c) {
+    if(virtual_mode) return ItemRef(nullptr, -1);
+    at = minmax(at, 0, items.GetCount());
+    FlowItemSpec s; s.expandingWeight = 1;
+    InsertItem(at, &c, s);
+    Relayout();
+    return ItemRef(this, at);
+}
 
-    if(debug) Refresh();
+void FlowBoxLayout::Remove(Handle h) {
+    const int i = IndexOf(h);
+    if(i < 0) return;
+    Item& it = items[i];
+    if(it.c) {
+        ctrl_slot.UnlinkKey(it.c);
+        it.c->Remove();
+    }
+    FreeSlot(it.slot);
+    items.Remove(i);
+    solver.Remove(i);
+    Reindex(i, items.GetCount());
+    ApplyFilter(i, items.GetCount());
+    ++cur_gen;
+    if(debug) Refresh();               // its box is no longer committed anywhere
+    Relayout();
+}
+
+void FlowBoxLayout::Move(int from, int to) {
+    const int n = items.GetCount();
+    if(virtual_mode || from < 0 || from >= n || from == to) return;
+    to = minmax(to, 0, n - 1);
+    const Item it = items[from];
+    items.Remove(from);
+    items.Insert(to, it);
+    solver.Move(from, to);
+    if(it.c) AddChildAt(it.c, to + 1);  // child order follows item order (tab, focus)
+    Reindex(min(from, to), max(from, to) + 1);
+    ApplyFilter(min(from, to), max(from, to) + 1);
+    ++cur_gen;
+    Relayout();
 }
 
-void FlowBoxLayout::PostLayoutCommit() {
-    for(Item& it : items) {
-        if(!it.cl.visible) continue;
-        if(it.c)
-            it.c->SetRect(it.cl.content);
+FlowBoxLayout& FlowBoxLayout::Reconcile(const Vector<String>& keys, Function<Ctrl *(const String&)> create,
+                                        Event<const String&, Ctrl&> update) {
+    if(virtual_mode) return *this;
+
+    // the Ctrl of every key, and the index of its item now (-1: none yet)
+    VectorMap<String, One<Ctrl>> next;
+    Vector<int> from;
+    for(const String& k : keys) {
+        if(next.Find(k) >= 0) continue;
+        One<Ctrl> c;
+        const int q = keyed.Find(k);
+        if(q >= 0)
+            c = pick(keyed[q]);
+        else
+            c.Attach(create(k));
+        if(!c) continue;               // the factory declined this key
+        from.Add(IndexOf(*c));
+        next.Add(k, pick(c));
     }
+
+    // items [lo, n - tail) are replaced by [lo, m - tail) of the new list
+    const int n = items.GetCount(), m = from.GetCount();
+    int lo = 0;
+    while(lo < min(n, m) && from[lo] == lo)
+        ++lo;
+    int tail = 0;
+    while(tail < min(n, m) - lo && from[m - 1 - tail] == n - 1 - tail)
+        ++tail;
+    const int old_hi = n - tail, new_hi = m - tail;
+
+    // take the old span out, keeping the Ctrl side and spec of what stays
+    Vector<Item>         mid;
+    Vector<FlowItemSpec> mid_spec;
+    Vector<byte>         stays;
+    stays.SetCount(old_hi - lo, false);
+    for(int j = lo; j < new_hi; ++j)
+        if(from[j] >= 0)
+            stays[from[j] - lo] = true;
+    for(int i = lo; i < old_hi; ++i) {
+        Item& it = items[i];
+        mid.Add(it);
+        mid_spec.Add(solver.GetSpec(i));
+        if(stays[i - lo]) continue;
+        if(it.c) {
+            ctrl_slot.UnlinkKey(it.c);
+            it.c->Remove();
+        }
+        FreeSlot(it.slot);
+    }
+    items.Remove(lo, old_hi - lo);
+    solver.Remove(lo, old_hi - lo);
+    items.InsertN(lo, new_hi - lo);
+    solver.Insert(lo, FlowItemSpec(), new_hi - lo);
+
+    // fill it in backwards: a new or moved child goes before the one after
+    // it, so the child order (tab, focus) follows the items
+    for(int j = new_hi - 1; j >= lo; --j) {
+        if(from[j] >= 0) {
+            items[j] = mid[from[j] - lo];
+            solver.SetSpec(j, mid_spec[from[j] - lo]);
+            if(items[j].c)
+                AddChildAt(items[j].c, j + 1);
+            continue;
+        }
+        Ctrl* c = ~next[j];
+        FlowItemSpec s; s.fit = true;
+        AddChildAt(c, j + 1);
+        SetupItem(items[j], c, s);
+        solver.SetSpec(j, s);
+    }
+    Reindex(lo, items.GetCount());
+    ++cur_gen;
+
+    keyed = pick(next);                // deletes the Ctrls of the keys gone
+    for(int q = 0; q < keyed.GetCount(); ++q)
+        update(keyed.GetKey(q), *keyed[q]);
+    ApplyFilter(lo, old_hi == new_hi ? new_hi : items.GetCount());
+    if(debug) Refresh();
+    Relayout();
+    return *this;
 }
 
-void FlowBoxLayout::PreLayoutCalc(const Rect& irc) {
-    plan_inner = irc.GetSize();
+Ctrl* FlowBoxLayout::GetKeyCtrl(const String& key) {
+    One<Ctrl>* c = keyed.FindPtr(key);
+    return c ? ~*c : nullptr;
+}
 
-    // reset transient cache
-    for(Item& it : items)
-        it.cl = Item::TransientLayoutCache{};
+FlowBoxLayout& FlowBoxLayout::SetFilter(Gate<int> pass) {
+    filter = pass;
+    return RefreshFilter();
+}
 
-    used_w = used_h = 0;
+FlowBoxLayout& FlowBoxLayout::RefreshFilter() {
+    for(int i = 0; i < items.GetCount(); ++i)
+        ApplyFilter(i);
+    Relayout();
+    return *this;
+}
 
-    const int inner_w = max(0, irc.GetWidth());
-    const int inner_h = max(0, irc.GetHeight());
+// The filter takes indices: after a structural edit every item whose index
+// changed is tested again.
+void FlowBoxLayout::ApplyFilter(int lo, int hi) {
+    if(filter)
+        for(int i = lo; i < hi; ++i)
+            ApplyFilter(i);
+}
 
-    // mark visible
-    int visible_semantic = 0;
-    for(Item& it : items) {
-        const bool semantic = it.is_break || (!it.c && !it.is_break); // break or spacer
-        const bool vis_ctrl = it.c && it.c->IsShown();
-        if(!(vis_ctrl || semantic)) continue;
-        it.cl.visible = true;
-        it.cl.spacer  = (!it.c && !it.is_break);
-        ++visible_semantic;
+void FlowBoxLayout::ApplyFilter(int i) {
+    Item& it = items[i];
+    const bool out = filter && !filter(i);
+    if(out == it.filtered) return;
+    it.filtered = out;
+    if(it.c) {
+        own_show = true;
+        if(out && it.c->IsShown()) {
+            it.c->Hide();
+            it.filter_hid = true;
+        }
+        else
+        if(!out && it.filter_hid) {
+            it.c->Show();
+            it.filter_hid = false;
+        }
+        own_show = false;
     }
+    solver.SetVisible(i, !out && (!it.c || it.c->IsShown()));
+    MarkDirty(i);
+}
+
+bool FlowBoxLayout::ChildStateHook(Ctrl* c, int reason) {
+    if(reason == SHOW)
+        if(FlowBoxLayout* fb = dynamic_cast<FlowBoxLayout*>(c->GetParent()))
+            fb->ChildShown(*c);
+    return false;
+}
 
-    if(visible_semantic == 0) {
-        used_w = used_h = 0;
-        plan_gen = cur_gen;
+void FlowBoxLayout::ChildShown(Ctrl& c) {
+    if(own_show) return;
+    const int i = IndexOf(c);
+    if(i < 0) return;                  // not ours (virtual pool) or not an item
+    Item& it = items[i];
+    if(it.filtered) {
+        // stays hidden while filtered out; shown again once it passes
+        if(c.IsShown()) {
+            own_show = true;
+            c.Hide();
+            own_show = false;
+            it.filter_hid = true;
+        }
         return;
     }
+    if(solver.IsVisible(i) == c.IsShown()) return;
+    solver.SetVisible(i, c.IsShown());
+    MarkDirty(i);
+    Relayout();
+}
 
-    if(dir == H)
-        LayoutHorizontal(irc, inner_w, inner_h, visible_semantic);
-    else
-        LayoutVertical  (irc, inner_w, inner_h, visible_semantic);
-
-    plan_gen = cur_gen;
+FlowBoxLayout::Handle FlowBoxLayout::GetHandle(int i) const {
+    Handle h;
+    if(i >= 0 && i < items.GetCount() && items[i].slot >= 0) {
+        h.slot = items[i].slot;
+        h.gen  = slot_gen[h.slot];
+    }
+    return h;
 }
 
+int FlowBoxLayout::IndexOf(Handle h) const {
+    if(h.slot < 0 || h.slot >= slot_gen.GetCount() || slot_gen[h.slot] != h.gen) return -1;
+    return slot_item[h.slot];
+}
 
-void FlowBoxLayout::LayoutHorizontal(const Rect& irc, int inner_w, int inner_h, int /*visible_semantic*/) {
-    // Local structs stay in .cpp (no header bloat)
-    struct RowCell {
-        int   idx   = -1;
-        bool  is_ctrl = false;
-        int   w     = 0;
-        int   base_h= 0;
-        int   hmin  = -1, hmax = INT_MAX;
-        Align self_align = Align::Auto;
-    };
-    struct GapExp { int idx; int weight; int minw; };
+int FlowBoxLayout::IndexOf(const Ctrl& c) const {
+    const int *slot = ctrl_slot.FindPtr(const_cast<Ctrl*>(&c));
+    return slot ? slot_item[*slot] : -1;
+}
 
-    auto eff_align = [&](const Item& it)->Align {
-        return (it.align_self != Align::Auto) ? it.align_self : align_items;
-    };
+int FlowBoxLayout::AllocSlot() {
+    if(slot_free.GetCount())
+        return slot_free.Pop();
+    slot_item.Add(-1);
+    slot_gen.Add(0);
+    return slot_item.GetCount() - 1;
+}
 
-    Vector<Vector<RowCell>> rows;
-    Vector<Vector<GapExp>>  row_gap_exp;
-    rows.Reserve(max(1, items.GetCount() / 8));
-    row_gap_exp.Reserve(max(1, items.GetCount() / 8));
-    rows.Add(); row_gap_exp.Add();
+void FlowBoxLayout::FreeSlot(int slot) {
+    if(slot < 0) return;
+    slot_item[slot] = -1;
+    ++slot_gen[slot];
+    slot_free.Add(slot);
+}
 
-    int x_row  = irc.left;
-    int placed = 0;
+void FlowBoxLayout::Reindex(int from, int to) {
+    for(int i = from; i < to; ++i)
+        if(items[i].slot >= 0)
+            slot_item[items[i].slot] = i;
+}
 
-    auto new_row = [&](){
-        rows.Add();
-        row_gap_exp.Add();
-        x_row  = irc.left;
-        placed = 0;
-    };
+void FlowBoxLayout::SetConstraintSize(int i, FlowConstraintSize* s) {
+    Item& it = items[i];
+    if(it.nested) return;              // nested flows answer for themselves
+    it.sizer    = s;
+    it.cs_epoch = 0;
+    FlowItemSpec sp = solver.GetSpec(i);
+    sp.hfw = s != nullptr;
+    solver.SetSpec(i, sp);
+}
 
-    // PASS 1: build rows (width base)
-    for(int i = 0; i < items.GetCount(); ++i) {
-        Item& it = items[i];
-        if(!it.cl.visible) continue;
-
-        // wrap + break = newline marker
-        if(wrap && it.is_break) {
-            it.cl.breakMark = true;
-            it.cl.rowOrCol  = rows.GetCount() - 1;
-            if(rows.Top().GetCount() > 0 || row_gap_exp.Top().GetCount() > 0)
-                new_row();
-            continue;
-        }
+FlowBoxLayout& FlowBoxLayout::ClearItems() {
+    for(Ctrl *q = GetFirstChild(); q; ) {
+        Ctrl* next = q->GetNext();
+        q->Remove();
+        q = next;
+    }
+    for(const Item& it : items)
+        FreeSlot(it.slot);
+    ctrl_slot.Clear();
+    keyed.Clear();
+    items.Clear();
+    solver.Clear();
+    vpool.Clear();
+    vpool_item.Clear();
+    virtual_mode = false;
+    virtual_spec.Clear();
+    virtual_create.Clear();
+    virtual_bind.Clear();
+    used_w = used_h = 0;
+    prog_next = prog_commit = INT_MAX;
+    MarkDirtyAll();
+    Relayout();
+    return *this;
+}
 
-        // fixed-column mode
-        if(fixed_column >= 0) {
-            const int cell_w = fixed_column;
-
-            if(!wrap && it.is_break) {
-                RowCell rc; rc.idx=i; rc.is_ctrl=false; rc.w=cell_w; rc.hmin=it.minh; rc.hmax=it.maxh; rc.base_h=0;
-                if(placed > 0) x_row += gap;
-                it.cl.rowOrCol = rows.GetCount() - 1;
-                rows.Top().Add(rc);
-                x_row += cell_w; ++placed;
-                continue;
-            }
-            if(it.cl.spacer) {
-                if(wrap) {
-                    int need = (placed == 0 ? cell_w : (x_row - irc.left) + gap + cell_w);
-                    if(need > inner_w && (rows.Top().GetCount() > 0 || row_gap_exp.Top().GetCount() > 0))
-                        new_row();
-                }
-                RowCell rc; rc.idx=i; rc.is_ctrl=false; rc.w=cell_w; rc.hmin=it.minh; rc.hmax=it.maxh; rc.base_h=0;
-                if(placed > 0) x_row += gap;
-                it.cl.rowOrCol = rows.GetCount() - 1;
-                rows.Top().Add(rc);
-                x_row += cell_w; ++placed;
-                continue;
-            }
+FlowBoxLayout& FlowBoxLayout::SetVirtual(int count, Event<int, VirtualItem&> spec,
+                                         Function<Ctrl *()> create, Event<int, Ctrl&> bind) {
+    PauseLayout();
+    ClearItems();
+    virtual_mode   = true;
+    virtual_spec   = spec;
+    virtual_create = create;
+    virtual_bind   = bind;
+    SetVirtualCount(count);
+    ResumeLayout();
+    return *this;
+}
 
-            const Size ms = GetCtrlMinSize(it);
-            if(wrap) {
-                int need = (placed==0 ? cell_w : (x_row - irc.left) + gap + cell_w);
-                if(need > inner_w && (rows.Top().GetCount() > 0 || row_gap_exp.Top().GetCount() > 0))
-                    new_row();
+FlowBoxLayout& FlowBoxLayout::SetVirtualCount(int count) {
+    if(!virtual_mode) return *this;
+    count = max(0, count);
+    const int n = items.GetCount();
+    if(count < n) {
+        // recycle Ctrls bound to items that no longer exist
+        for(int k = 0; k < vpool.GetCount(); ++k)
+            if(vpool_item[k] >= count) {
+                vpool_item[k] = -1;
+                vpool[k].Hide();
             }
-            RowCell rc; rc.idx=i; rc.is_ctrl=true; rc.w=cell_w; rc.base_h=ms.cy; rc.hmin=it.minh; rc.hmax=it.maxh; rc.self_align=it.align_self;
-            if(placed > 0) x_row += gap;
-            it.cl.rowOrCol = rows.GetCount() - 1;
-            rows.Top().Add(rc);
-            x_row += cell_w; ++placed;
-            continue;
+        items.Trim(count);
+        solver.SetCount(count);
+    } else {
+        items.SetCount(count);
+        solver.SetCount(count);
+        for(int i = n; i < count; ++i) {
+            LoadVirtualSpec(i);
+            if(filter) ApplyFilter(i);
         }
+    }
+    ++cur_gen;
+    Relayout();
+    return *this;
+}
 
-        // fluid mode
-        if(!wrap && it.is_break) {
-            row_gap_exp.Top().Add(GapExp{ i, 1, max(0, gap) });
-            it.cl.rowOrCol = rows.GetCount() - 1;
-            continue;
-        }
-        if(it.cl.spacer) {
-            row_gap_exp.Top().Add(GapExp{ i, max(1, it.expandingWeight), 0 });
-            it.cl.rowOrCol = rows.GetCount() - 1;
-            continue;
-        }
+FlowBoxLayout& FlowBoxLayout::InvalidateVirtual(int i) {
+    if(!virtual_mode || i < 0 || i >= items.GetCount()) return *this;
+    LoadVirtualSpec(i);
+    const int slot = items[i].vslot;
+    if(slot >= 0)
+        virtual_bind(i, vpool[slot]);
+    MarkDirty(i); Relayout();
+    return *this;
+}
 
-        const Size ms = GetCtrlMinSize(it);
-        int base_w;
-        if(it.fixed >= 0)             base_w = it.fixed;
-        else if(it.fit) {
-            base_w = ms.cx;
-
-            // width-for-height for V child that wraps & auto-resizes
-            if(it.c) {
-                if(FlowBoxLayout* fb = dynamic_cast<FlowBoxLayout*>(it.c)) {
-                    if(fb->dir == V && fb->wrap && fb->wrap_auto_resize) {
-                        const int child_inner_h = max(0, inner_h - fb->inset.top - fb->inset.bottom);
-                        fb->PreLayoutCalc(RectC(0, 0, INT_MAX, child_inner_h));
-                        const int wantw = fb->used_w + fb->inset.left + fb->inset.right;
-                        base_w = max(base_w, wantw);
-                    }
-                }
-            }
-        }
-        else if(it.expandingWeight>0) base_w = 0;
-        else                          base_w = ms.cx;
+FlowBoxLayout& FlowBoxLayout::InvalidateVirtual() {
+    if(!virtual_mode) return *this;
+    for(int i = 0; i < items.GetCount(); ++i) {
+        LoadVirtualSpec(i);
+        const int slot = items[i].vslot;
+        if(slot >= 0)
+            virtual_bind(i, vpool[slot]);
+    }
+    MarkDirtyAll(); Relayout();
+    return *this;
+}
 
-        base_w = ClampWith(it.minw, it.maxw, base_w);
+void FlowBoxLayout::LoadVirtualSpec(int i) {
+    VirtualItem v;
+    virtual_spec(i, v);
+
+    FlowItemSpec it;
+    it.kind            = v.is_break ? FlowItemSpec::BREAK
+                       : v.spacer   ? FlowItemSpec::SPACER
+                                    : FlowItemSpec::CONTENT;
+    const bool content = it.kind == FlowItemSpec::CONTENT;
+    it.fixed           = v.fixed;
+    it.expandingWeight = (content ? max(0, v.expandingWeight) : max(1, v.expandingWeight));
+    it.fit             = v.fit;
+    it.minw            = v.minw;
+    it.maxw            = v.maxw;
+    it.minh            = v.minh;
+    it.maxh            = v.maxh;
+    it.align_self      = v.align_self;
+    it.min_size        = content ? v.min_size : Size(0,0);
+    it.visible         = !items[i].filtered;
+    solver.SetSpec(i, it);
+}
 
-        int candidate = (placed == 0 ? base_w : (x_row - irc.left) + gap + base_w);
-        if(wrap && base_w > 0) {
-            if(candidate > inner_w && (rows.Top().GetCount() > 0 || row_gap_exp.Top().GetCount() > 0)) {
-                new_row();
-                candidate = base_w;
-            }
-        }
+FlowBoxLayout& FlowBoxLayout::SetViewport(const Rect& r) {
+    viewport = r;
+    SyncVirtual();
+    return *this;
+}
 
-        RowCell rc; rc.idx=i; rc.is_ctrl=true; rc.w=base_w; rc.base_h=ms.cy; rc.hmin=it.minh; rc.hmax=it.maxh; rc.self_align=it.align_self;
-        if(placed > 0) x_row += gap;
-        it.cl.rowOrCol = rows.GetCount() - 1;
-        rows.Top().Add(rc);
-        x_row += base_w; ++placed;
-    }
-
-    // PASS 2A: base row heights
-    Vector<int> row_h_base;
-    row_h_base.SetCount(rows.GetCount());
-    for(int r = 0; r < rows.GetCount(); ++r) {
-        const auto& R = rows[r];
-        int row_h = 0;
-        for(const RowCell& rc : R) {
-            int ch = ClampWith(rc.hmin, rc.hmax, rc.base_h);
-            row_h = max(row_h, ch);
-        }
-        if(fixed_row >= 0) row_h = fixed_row;
-        if(!wrap && (align_items == Align::Stretch || align_items == Align::Auto))
-            row_h = inner_h;
-        row_h_base[r] = row_h;
-    }
+void FlowBoxLayout::SyncVirtual() {
+    // Layout() only replans when needed; the commit step rebinds the window
+    if(virtual_mode) Layout();
+}
 
-    // PASS 2B: optionally distribute extra height across wrapped rows
-    Vector<int> row_h_final;
-    row_h_final <<= row_h_base; // deep copy (U++ idiom)
-    const bool measuring = inner_h > 100000000; // treat huge heights as probes
-    
-    // reuse the existing switch: auto-resize implies “wrap rows expand”
-    if(wrap && wrap_rows_expand && !measuring && rows.GetCount() > 0) {
-
-        int base_total = 0;
-        for(int r = 0; r < rows.GetCount(); ++r) base_total += row_h_base[r];
-        base_total += max(0, rows.GetCount() - 1) * gap;
-
-        int extra = max(0, inner_h - base_total);
-        if(extra > 0) {
-            int each = extra / rows.GetCount();
-            int rem  = extra % rows.GetCount();
-            for(int r = 0; r < rows.GetCount(); ++r)
-                row_h_final[r] += each + (r < rem ? 1 : 0);
-        }
-    }
+Ctrl* FlowBoxLayout::GetVirtualCtrl(int i) const {
+    if(!virtual_mode || i < 0 || i >= items.GetCount() || items[i].vslot < 0) return nullptr;
+    return &const_cast<FlowBoxLayout*>(this)->vpool[items[i].vslot];
+}
 
-    // PASS 2C: expand widths within row + place cells
-    used_w = used_h = 0;
-    int y = irc.top;
-
-    for(int r = 0; r < rows.GetCount(); ++r) {
-        auto& R  = rows[r];
-        auto& GE = row_gap_exp[r];
-        const int row_h = row_h_final[r];
-
-        // provisional width
-        int sum_w = 0, cell_count = 0;
-        for(const RowCell& rc : R) { if(cell_count++>0) sum_w += gap; sum_w += rc.w; }
-        for(const auto& g : GE)    { sum_w += gap; sum_w += g.minw; }
-
-        int remainder = max(0, inner_w - sum_w);
-
-        // distribute width
-        if(fixed_column < 0 && remainder > 0) {
-            int total_w = 0;
-            Vector<int> exp_idx; exp_idx.Reserve(R.GetCount());
-            for(int i = 0; i < R.GetCount(); ++i) {
-                const RowCell& rc = R[i];
-                const Item& it = items[rc.idx];
-                if(it.expandingWeight > 0) { total_w += max(1, it.expandingWeight); exp_idx.Add(i); }
-            }
-            for(const auto& g : GE) total_w += g.weight;
-
-            if(total_w > 0) {
-                int rem = remainder;
-                // controls first
-                for(int k = 0; k < exp_idx.GetCount() && rem > 0; ++k) {
-                    RowCell& rc = R[exp_idx[k]];
-                    Item& it = items[rc.idx];
-
-                    int share = (int)((int64)remainder * max(1, it.expandingWeight) / total_w);
-                    if(share == 0 && rem > 0) share = 1;
-                    share = min(share, rem);
-                    rem -= share;
-
-                    int neww = ClampWith(it.minw, it.maxw, rc.w + share);
-                    int consumed = neww - rc.w;
-                    if(consumed < share) rem += (share - consumed);
-                    rc.w = neww;
-                }
-                // then gaps/spacers
-                for(int k = 0; k < GE.GetCount() && rem > 0; ++k) {
-                    GapExp& g = GE[k];
-                    int share = (int)((int64)remainder * g.weight / total_w);
-                    if(share == 0 && rem > 0) share = 1;
-                    share = min(share, rem);
-                    rem -= share;
-                    g.minw += share;
-                }
-            }
-        }
+int FlowBoxLayout::ItemAt(Point p) const {
+    const_cast<FlowBoxLayout*>(this)->FlushLayout();
+    return solver.ItemAt(p);
+}
 
-        // place left→right
-        int x = irc.left;
-        int placed_in_row = 0;
-
-        for(int i = 0; i < R.GetCount(); ++i) {
-            RowCell& rc = R[i];
-            if(placed_in_row > 0) x += gap;
-            Item& it = items[rc.idx];
-
-            // vertical (cross-axis)
-            int ch = ClampWith(rc.hmin, rc.hmax, rc.base_h);
-            Align va = eff_align(it);
-            int topy = y;
-            if(va == Align::Center)      topy = y + (row_h - ch) / 2;
-            else if(va == Align::End)    topy = y + (row_h - ch);
-            else if(va == Align::Stretch || va == Align::Auto) { ch = ClampWith(rc.hmin, rc.hmax, row_h); topy = y; }
-
-            // write cell rect
-            it.cl.cell = Rect(x, y, x + rc.w, y + row_h);
-            it.cl.rowOrCol = r;
-
-            // content rect
-            if(it.c) {
-                int cx = x, avail_w = rc.w;
-                // if you’re in fixed_column path we already used cell width; content padding handled below
-                int natural_w;
-                const Size ms = GetCtrlMinSize(it);
-                if(it.fixed >= 0)               natural_w = it.fixed;
-                else if(it.fit)                 natural_w = ms.cx;
-                else if(it.expandingWeight > 0) natural_w = avail_w;
-                else                             natural_w = ms.cx;
-                natural_w = ClampWith(it.minw, it.maxw, natural_w);
-
-                Align ha = eff_align(it);
-                int cw;
-                if(ha == Align::Stretch || ha == Align::Auto || it.expandingWeight > 0) {
-                    cw = avail_w;
-                } else {
-                    cw = min(natural_w, avail_w);
-                    if(ha == Align::Center) cx += (avail_w - cw)/2;
-                    else if(ha == Align::End) cx += (avail_w - cw);
-                }
-
-                it.cl.content = Rect(cx, topy, cx + cw, topy + ch);
-            } else {
-                it.cl.content = Rect(0,0,0,0);
-            }
+void FlowBoxLayout::ItemsIn(const Rect& r, Vector<int>& out) const {
+    const_cast<FlowBoxLayout*>(this)->FlushLayout();
+    solver.ItemsIn(r, out);
+}
 
-            x += rc.w;
-            ++placed_in_row;
-        }
+Rect FlowBoxLayout::GetItemRect(int i) const {
+    const_cast<FlowBoxLayout*>(this)->FlushLayout();
+    return i >= 0 && i < items.GetCount() ? solver.GetItemRect(i) : Rect(Null);
+}
 
-        used_w = max(used_w, x - irc.left);
-        used_h = max(used_h, (y - irc.top) + row_h);
+void FlowBoxLayout::State(int reason) {
+    ParentCtrl::State(reason);
+    // a deferred pass must not wait for the timer once we are on screen
+    if(layout_pending && (reason == OPEN || reason == SHOW))
+        Layout();
+    // the host scrolls us by moving our rect; follow the visible window
+    if(virtual_mode && (reason == POSITION || reason == OPEN))
+        SyncVirtual();
+}
 
-        y += row_h;
-        if(r + 1 < rows.GetCount()) y += gap;
+Rect FlowBoxLayout::GetVirtualViewport() const {
+    if(!IsNull(viewport)) return viewport;
+    if(!IsOpen()) return Rect(0,0,0,0);       // nothing on screen yet
+    return GetVisibleScreenView() - GetScreenView().TopLeft();
+}
+
+void FlowBoxLayout::Relayout() {
+    if(layout_pause > 0) return;
+    if(!deferred) { Layout(); return; }
+    if(layout_pending) return;         // one pass per event-loop tick
+    layout_pending = true;
+    SetTimeCallback(0, [this] { FlushLayout(); }, TIMEID_LAYOUT);
+}
+
+void FlowBoxLayout::Layout() {
+    LayoutPass(progressive ? prog_budget : 0);
+}
+
+void FlowBoxLayout::LayoutPass(int budget_ms) {
+    if(layout_pause > 0) return;       // ← short-circuit when paused
+    if(layout_pending) {               // this pass serves the scheduled one
+        layout_pending = false;
+        KillTimeCallback(TIMEID_LAYOUT);
     }
+    KillTimeCallback(TIMEID_PROGRESS); // ...and goes on with a progressive run
+    Rect rc = GetSize();
+    if(rc.IsEmpty()) { used_w = used_h = 0; return; }
+
+    Rect irc = rc;
+    irc.left   += inset.left;
+    irc.top    += inset.top;
+    irc.right  -= inset.right;
+    irc.bottom -= inset.bottom;
+    if(irc.IsEmpty()) { used_w = used_h = 0; return; }
+
+    // (the virtual mode only builds the visible children anyway)
+    const int deadline = budget_ms > 0 && !virtual_mode ? msecs() + budget_ms : INT_MAX;
+    if(solver.GetPlanSize() != irc.GetSize() || plan_gen != cur_gen || prog_next < items.GetCount())
+        PreLayoutCalc(irc, deadline);
+
+    const Rect damage = PostLayoutCommit(deadline);
+
+    provisional = prog_next < items.GetCount() || prog_commit < items.GetCount();
+    if(provisional)
+        SetTimeCallback(0, [this] { Layout(); }, TIMEID_PROGRESS);
+
+    // children repaint themselves when moved; only the overlay is ours
+    if(debug && !IsNull(damage)) Refresh(damage);
 }
 
-void FlowBoxLayout::LayoutVertical(const Rect& irc, int inner_w, int inner_h, int /*visible_semantic*/) {
-    struct VCell { int idx; int h; int wshare; };
+// Records the committed cell of an item; a change adds old and new cell to
+// the damaged region.
+void FlowBoxLayout::CommitCell(Item& it, const FlowCell& cl, Rect& damage) {
+    const Rect cell = cl.visible ? cl.cell : Rect(Null);
+    if(cell == it.committed_cell) return;
+    for(const Rect& r : { it.committed_cell, cell })
+        if(!IsNull(r))
+            damage = IsNull(damage) ? r : damage | r;
+    it.committed_cell = cell;
+}
 
-    auto eff_align = [&](const Item& it)->Align {
-        return (it.align_self != Align::Auto) ? it.align_self : align_items;
-    };
+// Moves only the children whose rect changed since the last commit (SetRect
+// may relayout and repaint a whole subtree) and returns the union of the
+// cells that changed, Null if none.
+// With a deadline, the items in the viewport go first, then the others
+// from where the previous pass stopped.
+Rect FlowBoxLayout::PostLayoutCommit(int deadline) {
+    Rect damage = Null;
+    prog_commit = min(prog_commit, items.GetCount());
+    if(virtual_mode) { CommitVirtual(damage); prog_commit = INT_MAX; return damage; }
+    if(deadline == INT_MAX) {
+        for(int i = 0; i < items.GetCount(); ++i)
+            CommitItem(i, damage);
+        prog_commit = INT_MAX;
+        return damage;
+    }
+    solver.ItemsIn(GetVirtualViewport(), vp_items);
+    for(int i : vp_items)
+        CommitItem(i, damage);
+    while(prog_commit < items.GetCount() && msecs() < deadline)
+        CommitItem(prog_commit++, damage);
+    if(prog_commit == items.GetCount())
+        prog_commit = INT_MAX;
+    return damage;
+}
 
-    Vector<VCell> cells;
-    cells.Reserve(items.GetCount());
+void FlowBoxLayout::CommitItem(int i, Rect& damage) {
+    Item& it = items[i];
+    const FlowCell& cl = solver.GetCell(i);
+    CommitCell(it, cl, damage);
+    if(!it.c) return;
+    if(!cl.visible) { it.committed = Null; return; }
+    if(cl.content != it.committed) {
+        it.c->SetRect(cl.content);
+        it.committed = cl.content;
+        if(solver.IsHfw(i))
+            minsize_gen = -1;          // a nested flow’s min size follows its width
+    }
+    // arrange nested flows top-down in this pass (an unchanged rect does
+    // not lay them out, but their content may have changed)
+    if(it.nested)
+        static_cast<FlowBoxLayout*>(it.c)->FlushLayout();
+}
 
-    int base_sum_h = 0;
-    int exp_weight_sum = 0;
+void FlowBoxLayout::NotifyParent(bool always) {
+    if(!always && (parent_notified || !wrap || !wrap_auto_resize)) return;
+    FlowBoxLayout* parent = dynamic_cast<FlowBoxLayout*>(GetParent());
+    if(!parent) return;
+    parent_notified = true;
+    parent->InvalidateMinSize(*this);
+    parent->Relayout();
+}
 
-    // build cells
-    for(int i = 0; i < items.GetCount(); ++i) {
-        Item& it = items[i];
-        if(!it.cl.visible) continue;
+void FlowBoxLayout::CommitVirtual(Rect& damage) {
+    Rect vp = GetVirtualViewport();
+    vp.Inflate(virtual_overscan);
+
+    // recycle Ctrls whose items left the viewport
+    for(int k = 0; k < vpool.GetCount(); ++k) {
+        const int i = vpool_item[k];
+        if(i < 0) continue;
+        const FlowCell& cl = solver.GetCell(i);
+        if(cl.visible && cl.content.Intersects(vp)) continue;
+        items[i].committed = Null;
+        items[i].vslot = -1;
+        vpool_item[k]  = -1;
+        vpool[k].Hide();
+    }
 
-        VCell c; c.idx = i; c.h = 0; c.wshare = 0;
+    // the overlay's damage needs every cell; binding only the viewport's
+    if(debug)
+        for(int i = 0; i < items.GetCount(); ++i)
+            CommitCell(items[i], solver.GetCell(i), damage);
 
-        if(fixed_row >= 0) {
-            c.h = fixed_row;
-        } else {
-            if(it.is_break) {
-                c.h = max(gap, 0);
-                if(it.expandingWeight <= 0) c.wshare = 1; // gap-expander
-            }
-            else if(it.cl.spacer) {
-                c.h = 0;
-                c.wshare = max(1, it.expandingWeight);
-            }
-            else {
-                const Size ms = GetCtrlMinSize(it);
-                if(it.fixed >= 0)             c.h = it.fixed;
-                else if(it.fit) {
-                    c.h = ms.cy;
-
-                    // height-for-width for H child that wraps & auto-resizes
-                    if(it.c) {
-                        if(FlowBoxLayout* fb = dynamic_cast<FlowBoxLayout*>(it.c)) {
-                            if(fb->dir == H && fb->wrap && fb->wrap_auto_resize) {
-                                const int child_inner_w = max(0, inner_w - fb->inset.left - fb->inset.right);
-                                fb->PreLayoutCalc(RectC(0, 0, child_inner_w, INT_MAX));
-                                const int wanth = fb->used_h + fb->inset.top + fb->inset.bottom;
-                                c.h = max(c.h, wanth);
-                            }
-                        }
-                    }
-                }
-                else if(it.expandingWeight>0) c.h = 0;
-                else                          c.h = ms.cy;
-                if(it.expandingWeight>0)      c.wshare = max(1, it.expandingWeight);
+    // bind items entering the viewport (reuse free Ctrls first), found
+    // through the hit index: the cost follows the window, not the count
+    int free_k = 0;
+    solver.ItemsIn(vp, vp_items);
+    for(int i : vp_items) {
+        Item& it = items[i];
+        const FlowCell& cl = solver.GetCell(i);
+        if(!cl.visible || !cl.content.Intersects(vp)) continue;
+        if(it.vslot < 0) {
+            while(free_k < vpool.GetCount() && vpool_item[free_k] >= 0) ++free_k;
+            if(free_k == vpool.GetCount()) {
+                Ctrl* c = virtual_create ? virtual_create() : nullptr;
+                if(!c) continue;
+                vpool.Add(c);
+                vpool_item.Add(-1);
+                ParentCtrl::Add(*c);
             }
-            c.h = ClampWith(it.minh, it.maxh, c.h);
-        }
-
-        base_sum_h += c.h;
-        exp_weight_sum += c.wshare;
-        cells.Add(c);
-    }
-
-    // distribute remainder
-    const int gaps_total = max(0, cells.GetCount() - 1) * gap;
-    int remainder = (fixed_row >= 0 ? 0 : max(0, inner_h - (base_sum_h + gaps_total)));
-
-    if(fixed_row < 0 && exp_weight_sum > 0 && remainder > 0) {
-        int rem = remainder;
-        for(int k = 0; k < cells.GetCount(); ++k) {
-            if(cells[k].wshare <= 0) continue;
-            int share = (int)((int64)remainder * cells[k].wshare / exp_weight_sum);
-            if(share == 0 && rem > 0) share = 1;
-            share = min(share, rem);
-            rem -= share;
-
-            Item& it = items[cells[k].idx];
-            int nh = ClampWith(it.minh, it.maxh, cells[k].h + share);
-            int consumed = nh - cells[k].h;
-            if(consumed < share) rem += (share - consumed);
-            cells[k].h = nh;
-            if(rem == 0) break;
+            it.vslot = free_k;
+            vpool_item[free_k] = i;
+            virtual_bind(i, vpool[free_k]);
+            vpool[free_k].Show();
         }
-        if(rem > 0) {
-            for(int k = 0; k < cells.GetCount() && rem > 0; ++k) {
-                if(cells[k].wshare <= 0) continue;
-                Item& it = items[cells[k].idx];
-                int room = (it.maxh >= 0 ? it.maxh : INT_MAX) - cells[k].h;
-                if(room <= 0) continue;
-                int take = min(room, rem);
-                cells[k].h += take;
-                rem -= take;
-            }
+        if(cl.content != it.committed) {
+            vpool[it.vslot].SetRect(cl.content);
+            it.committed = cl.content;
         }
     }
+}
 
-    // place top→bottom
-    int y = irc.top;
-    int max_w = 0;
-
-    for(int k = 0; k < cells.GetCount(); ++k) {
-        Item& it = items[cells[k].idx];
-        it.cl.cell = Rect(irc.left, y, irc.right, y + cells[k].h);
-        it.cl.rowOrCol = k;
+FlowLayoutConfig FlowBoxLayout::GetConfig() const {
+    FlowLayoutConfig cfg;
+    cfg.dir              = dir;
+    cfg.align_items      = align_items;
+    cfg.gap              = gap;
+    cfg.wrap             = wrap;
+    cfg.wrap_rows_expand = wrap_rows_expand;
+    cfg.fixed_column     = fixed_column;
+    cfg.fixed_row        = fixed_row;
+    cfg.masonry          = masonry;
+    cfg.wrap_balance     = wrap_balance;
+    cfg.wrap_balance_max = wrap_balance_max;
+    cfg.justify_row      = justify_row;
+    return cfg;
+}
 
-        if(it.c) {
-            const Size ms = GetCtrlMinSize(it);
-            Align ha = eff_align(it);
-            int natural_w = (it.fixed >= 0 ? it.fixed : ms.cx);
-            natural_w = ClampWith(it.minw, it.maxw, natural_w);
-
-            int cw = (ha == Align::Stretch || ha == Align::Auto)
-                       ? ClampWith(it.minw, it.maxw, inner_w)
-                       : min(natural_w, inner_w);
-            int cx = irc.left;
-            if(ha == Align::Center && cw < inner_w) cx = irc.left + (inner_w - cw) / 2;
-            else if(ha == Align::End && cw < inner_w) cx = irc.right - cw;
-
-            it.cl.content = Rect(cx, y, cx + cw, y + cells[k].h);
-            max_w = max(max_w, cw);
-        } else {
-            it.cl.content = Rect(0,0,0,0);
+void FlowBoxLayout::SyncSpec(int i, const FlowLayoutConfig& cfg) {
+    Item& it = items[i];
+    if(!it.c) return;                  // spacers, breaks and virtual items keep their spec
+    const bool visible = !it.filtered && it.c->IsShown();
+    if(!visible) {                     // keeps its min size until shown again
+        if(solver.IsVisible(i)) {
+            solver.SetVisible(i, false);
+            MarkDirty(i);
         }
+        return;
+    }
+    // fixed cells: the rects do not depend on the min size, skip the query
+    // (a config change resyncs every item)
+    const Size ms = solver.UsesMinSize(cfg, i) ? GetCtrlMinSize(it) : solver.GetMinSize(i);
+    if(!solver.IsVisible(i) || solver.GetMinSize(i) != ms) {
+        solver.SetVisible(i, true);
+        solver.SetMinSize(i, ms);
+        MarkDirty(i);
+    }
+}
 
-        y += cells[k].h;
-        if(k + 1 < cells.GetCount()) y += gap;
+void FlowBoxLayout::PreLayoutCalc(const Rect& irc, int deadline) {
+    const FlowLayoutConfig cfg = GetConfig();
+    parent_notified = false;
+
+    // a resumed plan only re-reads the dirty items (ChildShown marks the
+    // children shown or hidden) and those a progressive pass held out;
+    // otherwise all are re-read
+    const int n = items.GetCount();
+    int lo = 0, hi = n - 1;
+    if(solver.CanResume(cfg, irc.GetSize())) {
+        lo = solver.GetDirtyLo();
+        hi = min(solver.GetDirtyHi(), n - 1);
+        if(prog_next < n) {
+            lo = min(lo, prog_next);
+            hi = n - 1;
+        }
+    }
+    // past the deadline, the min sizes not queried yet wait for the next
+    // pass (in item order: a row depends on the items before it); stale ones
+    // keep their old spec meanwhile, children never measured stay out
+    prog_next = INT_MAX;
+    for(int i = lo; i <= hi; ++i) {
+        Item& it = items[i];
+        if(deadline != INT_MAX && it.c && it.ms_epoch != minsize_epoch && !it.filtered && it.c->IsShown()
+           && solver.UsesMinSize(cfg, i) && msecs() >= deadline) {
+            if(prog_next == INT_MAX)
+                prog_next = i;
+            if(it.ms_epoch == 0 && solver.IsVisible(i)) {
+                solver.SetVisible(i, false);
+                MarkDirty(i);
+            }
+            continue;
+        }
+        SyncSpec(i, cfg);
     }
 
-    used_w = max_w;
-    used_h = min(inner_h, y - irc.top);
+    solver.Solve(cfg, irc);
+    if(deadline != INT_MAX)
+        prog_commit = 0;               // the moves start over on the new plan
+    used_w = solver.GetUsedWidth();
+    used_h = solver.GetUsedHeight();
+    plan_gen = cur_gen;
 }
 
+
 void FlowBoxLayout::InvalidateMinSize(Ctrl& c) {
-    for(Item& it : items) {
-        if(it.c == &c) {
-            it.ms_valid = false;
-            // do not Layout() here; let caller decide
-            return;
-        }
-    }
+    const int i = IndexOf(c);
+    if(i < 0) return;
+    Item& it = items[i];
+    const Size before = minsize_cache;
+    it.ms_epoch = it.cs_epoch = 0;
+    MarkDirty(i);
+    PropagateMinSize(before);
+    // do not Layout() here; let caller decide
+}
+
+void FlowBoxLayout::PropagateMinSize(Size before) {
+    FlowBoxLayout* parent = dynamic_cast<FlowBoxLayout*>(GetParent());
+    if(!parent) return;
+    // an unchanged aggregate leaves the parent’s plan valid
+    if(!IsNull(before) && GetMinSize() == before) return;
+    parent->InvalidateMinSize(*this);
 }
 
 void FlowBoxLayout::InvalidateAllMinSizes() {
+    const Size before = minsize_cache;
     // Bump epoch so all items become stale lazily
     ++minsize_epoch;
+    MarkDirtyAll();
     if(minsize_epoch == INT_MAX) {
         // Extremely unlikely; hard reset to keep logic simple
         minsize_epoch = 1;
         for(Item& it : items)
-            it.ms_valid = false;
+            it.ms_epoch = it.cs_epoch = 0;
     }
+    PropagateMinSize(before);
 }
 
 Size FlowBoxLayout::GetCtrlMinSize(Item& it) {
     if(!it.c) return Size(0,0);
-    if(!it.ms_valid || it.ms_epoch != minsize_epoch) {
+    if(it.ms_epoch != minsize_epoch) {
         it.cachedMinSize = it.c->GetMinSize();
         it.ms_epoch      = minsize_epoch;
-        it.ms_valid      = true;
     }
     return it.cachedMinSize;
 }
 
+int FlowBoxLayout::GetCtrlConstraintSize(int i, int at, bool height) {
+    Item& it = items[i];
+    if(!it.sizer) return 0;
+    const int key = height ? at : ~at;
+    if(it.cs_epoch != minsize_epoch || it.cs_at != key) {
+        it.cs_size  = height ? it.sizer->GetHeightForWidth(at) : it.sizer->GetWidthForHeight(at);
+        it.cs_at    = key;
+        it.cs_epoch = minsize_epoch;
+    }
+    return it.cs_size;
+}
+
+int FlowBoxLayout::GetHeightForWidth(int width) {
+    if(dir != H || !wrap || !wrap_auto_resize) return 0;
+    return MeasureHeightForWidth(width);
+}
+
+int FlowBoxLayout::GetWidthForHeight(int height) {
+    if(dir != V || !wrap || !wrap_auto_resize) return 0;
+    const int inner_h = max(0, height - inset.top - inset.bottom);
+    return Measure(RectC(0, 0, INT_MAX, inner_h)).cx + inset.left + inset.right;
+}
+
+Size FlowBoxLayout::Measure(const Rect& irc) {
+    parent_notified = false;
+    const Size key = irc.GetSize();
+    if(measure_gen == cur_gen && measure_epoch == minsize_epoch)
+        for(const MeasureEntry& e : measure_cache)
+            if(e.inner == key)
+                return e.used;
+
+    const FlowLayoutConfig cfg = GetConfig();
+    for(int i = 0; i < items.GetCount(); ++i)
+        SyncSpec(i, cfg);
+    if(measure_gen != cur_gen || measure_epoch != minsize_epoch) {
+        for(MeasureEntry& e : measure_cache)
+            e.inner = Null;
+        measure_gen   = cur_gen;
+        measure_epoch = minsize_epoch;
+    }
+    MeasureEntry& e = measure_cache[measure_next++ % __countof(measure_cache)];
+    e.inner = key;
+    e.used  = solver.Measure(cfg, irc);
+    return e.used;
+}
+
 int FlowBoxLayout::MeasureHeightForWidth(int width) {
     // Use the *inner* width that content actually gets
     Rect irc = RectC(0, 0, max(0, width - inset.left - inset.right), INT_MAX);
-    PreLayoutCalc(irc);                // plan rows/cells for that width
-    return used_h + inset.top + inset.bottom;  // height required (includes padding)
+    const Size used = Measure(irc);    // probe plan; the committed one stays
+    return used.cy + inset.top + inset.bottom;  // height required (includes padding)
 }
 
 Size FlowBoxLayout::GetMinSize() const {
+    // Parents and scroll hosts ask repeatedly (and recursively in nested
+    // flows); every change to items, config or child min sizes bumps the key.
+    int width = 0;                     // (the height for columns)
+    if(dir == H && wrap && wrap_auto_resize) {
+        width = GetSize().cx - inset.left - inset.right;
+        if(width <= 0) width = solver.GetPlanSize().cx;
+    }
+    if(dir == V && wrap && wrap_auto_resize) {
+        width = GetSize().cy - inset.top - inset.bottom;
+        if(width <= 0) width = solver.GetPlanSize().cy;
+    }
+    if(IsNull(minsize_cache) || minsize_gen != cur_gen ||
+       minsize_key_epoch != minsize_epoch || minsize_width != width) {
+        minsize_cache     = const_cast<FlowBoxLayout*>(this)->ComputeMinSize();
+        minsize_gen       = cur_gen;
+        minsize_key_epoch = minsize_epoch;
+        minsize_width     = width;
+    }
+    return minsize_cache;
+}
+
+Size FlowBoxLayout::ComputeMinSize() {
     // If horizontal + wrapping + auto-resize: report height-for-width based on current width.
     // This makes width-sensitive flows cooperate with generic scroll parents (e.g., StageCard).
     if(dir == H && wrap && wrap_auto_resize) {
         int eff_inner_w = GetSize().cx - inset.left - inset.right;
-        if(eff_inner_w <= 0) eff_inner_w = plan_inner.cx;
+        if(eff_inner_w <= 0) eff_inner_w = solver.GetPlanSize().cx;
         if(eff_inner_w <= 0) eff_inner_w = DPI(240); // conservative fallback
 
-        int h = const_cast<FlowBoxLayout*>(this)->MeasureHeightForWidth(eff_inner_w);
+        int h = MeasureHeightForWidth(eff_inner_w);
         if(h < 0) h = 0;
 
         // Width: keep current width as a conservative baseline (parent will set it anyway)
@@ -554,25 +837,39 @@ Size FlowBoxLayout::GetMinSize() const {
         return Size(baseline_w, h + inset.top + inset.bottom);
     }
 
+    // Vertical + wrapping + auto-resize: the width the columns need at the
+    // current height.
+    if(dir == V && wrap && wrap_auto_resize) {
+        int eff_inner_h = GetSize().cy - inset.top - inset.bottom;
+        if(eff_inner_h <= 0) eff_inner_h = solver.GetPlanSize().cy;
+        if(eff_inner_h <= 0) eff_inner_h = DPI(240); // conservative fallback
+
+        const int w = GetWidthForHeight(eff_inner_h + inset.top + inset.bottom);
+        return Size(w, max(1, GetSize().cy));
+    }
+
     // Default conservative computation (no height-for-width)
     int cross = 0, main = 0, visible = 0;
 
     if(dir == V) {
-        for(const Item& it : items) {
-            if(!(it.c && it.c->IsShown()))
-                continue;
+        for(int i = 0; i < items.GetCount(); ++i) {
+            const FlowItemSpec it = solver.GetSpec(i);
+            const Ctrl* c = items[i].c;
+            if(!(c ? c->IsShown() : it.kind == FlowItemSpec::CONTENT && it.visible))
+                continue;              // (virtual items: filtered out => not visible)
             ++visible;
 
-            const Size ms = it.c->GetMinSize();
+            // nested flows: their min size follows their width (own cache)
+            const Size ms = !c ? it.min_size : items[i].nested ? c->GetMinSize() : GetCtrlMinSize(items[i]);
 
             // Main-axis (height) with per-item caps and container fixed_row
-            int add = ClampWith(it.minh, it.maxh, basePrimary(it, ms, /*vertical*/true));
+            int add = FlowLayoutSolver::ClampWith(it.minh, it.maxh, basePrimary(it, ms, /*vertical*/true));
             if(fixed_row >= 0)
                 add = min(add, fixed_row);
             main += add;
 
             // Cross-axis (width) envelope
-            cross = max(cross, ClampWith(it.minw, it.maxw, ms.cx));
+            cross = max(cross, FlowLayoutSolver::ClampWith(it.minw, it.maxw, ms.cx));
         }
         if(visible > 1)
             main += (visible - 1) * gap;
@@ -580,21 +877,24 @@ Size FlowBoxLayout::GetMinSize() const {
         return Size(cross + inset.left + inset.right,
                     main  + inset.top  + inset.bottom);
     } else {
-        for(const Item& it : items) {
-            if(!(it.c && it.c->IsShown()))
-                continue;
+        for(int i = 0; i < items.GetCount(); ++i) {
+            const FlowItemSpec it = solver.GetSpec(i);
+            const Ctrl* c = items[i].c;
+            if(!(c ? c->IsShown() : it.kind == FlowItemSpec::CONTENT && it.visible))
+                continue;              // (virtual items: filtered out => not visible)
             ++visible;
 
-            const Size ms = it.c->GetMinSize();
+            // nested flows: their min size follows their width (own cache)
+            const Size ms = !c ? it.min_size : items[i].nested ? c->GetMinSize() : GetCtrlMinSize(items[i]);
 
             // Main-axis (width)
             const int snapped = (fixed_column >= 0 ? fixed_column
                                                    : basePrimary(it, ms, /*vertical*/false));
-            int add = ClampWith(it.minw, it.maxw, snapped);
+            int add = FlowLayoutSolver::ClampWith(it.minw, it.maxw, snapped);
             main += add;
 
             // Cross-axis (height) envelope
-            cross = max(cross, ClampWith(it.minh, it.maxh, ms.cy));
+            cross = max(cross, FlowLayoutSolver::ClampWith(it.minh, it.maxh, ms.cy));
         }
         if(visible > 1)
             main += (visible - 1) * gap;
@@ -686,31 +986,32 @@ void FlowBoxLayout::DebugPaint(Draw& w, const Rect& inner_rc) const {
     frame(inner_rc);
 
     // --- items
-    for(const Item& it : items) {
-        if(!it.cl.visible) continue;
+    for(int i = 0; i < items.GetCount(); ++i) {
+        const FlowCell& cl = solver.GetCell(i);
+        if(!cl.visible) continue;
 
         // cell box
-        frame(it.cl.cell);
+        frame(cl.cell);
 
       // Spacer → "←-→"
-        if(it.cl.spacer) {
+        if(cl.spacer) {
             const char* k = "\xE2\x86\x90-\xE2\x86\x92";
             Size ts = GetTextSize(k, f);
-            w.DrawText(it.cl.cell.left + (it.cl.cell.GetWidth() - ts.cx)/2,
-                       it.cl.cell.top  + (it.cl.cell.GetHeight()- ts.cy)/2,
+            w.DrawText(cl.cell.left + (cl.cell.GetWidth() - ts.cx)/2,
+                       cl.cell.top  + (cl.cell.GetHeight()- ts.cy)/2,
                        k, f, stroke);
         }
 
         // Hard break mark (if you choose to keep it)
-        if(it.cl.breakMark) {
+        if(cl.breakMark) {
             const char* br = "\xE2\x86\xB2";
             Size ts = GetTextSize(br, f);
-            w.DrawText(it.cl.cell.right - DPI(10), it.cl.cell.top + DPI(2), br, f, stroke);
+            w.DrawText(cl.cell.right - DPI(10), cl.cell.top + DPI(2), br, f, stroke);
         }
 
         // content outline
-        if(it.c)
-            frame(it.cl.content);
+        if(solver.IsContent(i))
+            frame(cl.content);
     }
 }
 
@@ -724,6 +1025,9 @@ String FlowBoxLayout::ToString() const {
       << ", inset=(" << inset.left << "," << inset.top << "," << inset.right << "," << inset.bottom << ")"
       << ", fixed_column=" << fixed_column
       << ", fixed_row="    << fixed_row
+      << ", masonry="      << (masonry ? "true" : "false")
+      << ", wrap_balance=" << (wrap_balance ? "true" : "false")
+      << ", justify_row="  << justify_row
       << ", items=" << items.GetCount()
       << ", used=(" << used_w << "x" << used_h << ")"
       << ", debug=" << (debug ? "on" : "off") << "}";
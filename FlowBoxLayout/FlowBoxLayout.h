@@ -16,7 +16,7 @@
 // ============
 // • Direction
 //     H: items are laid out from left to right; optional wrapping creates rows.
-//     V: items are stacked top to bottom; wrapping is ignored; think "column".
+//     V: items are stacked top to bottom; optional wrapping creates columns.
 //
 // • Item sizing modes (main axis):
 //     Fixed(px)   – use exactly px on the main axis (never grows/shrinks)
@@ -31,14 +31,21 @@
 //     SetFixedColumn(px) – in H mode, cap each item’s width to px (wrapping
 //                          respects this, yielding a “fixed column” look)
 //     SetFixedRow(px)    – in V mode, cap each item’s height to px
+//     SetMasonry(true)   – H+wrap with a fixed column: fill columns instead
+//                          of rows, each item under the shortest column
+//     SetWrapBalance()   – H+wrap: same row count, but the items spread
+//                          evenly over the rows (no lone last item)
+//     SetJustifiedRows(h)– H+wrap: scale rows of fixed-aspect items (photos)
+//                          to the full width, about h high
 //
 // • Spacing
 //     SetInset(...) – inner padding of the container
 //     SetGap(px)    – space between neighboring items (applies both axes)
 //
-// • Wrapping helpers (Horizontal mode)
-//     SetWrap(true)           – enable row wrapping
+// • Wrapping helpers
+//     SetWrap(true)           – enable row (H) or column (V) wrapping
 //     SetWrapAutoResize(true) – report natural height as a function of width
+//                               (H), width as a function of height (V)
 //                               (parents can query via GetMinSize/Measure…)
 //     SetWrapRowsExpand(true) – when the container has extra height, *rows*
 //                               grow to consume it (useful in card grids)
@@ -46,6 +53,11 @@
 // • Debug
 //     SetDebug(true) – draws an overlay for inset, rows/columns, and item rects
 //
+// • Engine
+//     The planning itself is done by FlowLayoutSolver (package
+//     FlowLayoutSolver, Core only); this control feeds it the children’s
+//     min sizes and visibility and commits the resulting rects.
+//
 // Typical usage
 // =============
 //     FlowBoxLayout fb(FlowBoxLayout::H);
@@ -60,89 +72,122 @@
 #include <CtrlLib/CtrlLib.h>
 #include <limits.h>
 
+#include <FlowLayoutSolver/FlowLayoutSolver.h>
+
 namespace Upp {
 
-class FlowBoxLayout : public ParentCtrl {
-public:
-    typedef FlowBoxLayout CLASSNAME;
+// -----------------------------------------------------------------------------
+// FlowConstraintSize
+//
+// Opt-in protocol for children whose size along one axis depends on the
+// other: wrapped text, rich-text previews, tiles that reflow, nested flows.
+// Inherit it next to Ctrl (or attach one with ItemRef::ConstraintSize) and a
+// FlowBoxLayout asks it for Fit() items: a V stack for the height at the cell
+// width, an H row for the width at the inner height; a masonry asks every
+// item for its height at the column width. Answers are cached per
+// item until the constraint changes or the item's min size is invalidated;
+// call FlowBoxLayout::InvalidateMinSize(ctrl) when they would change.
+// -----------------------------------------------------------------------------
+struct FlowConstraintSize {
+    virtual ~FlowConstraintSize() {}
 
-    // Primary direction of the flow. H enables optional wrapping; V stacks.
-    enum Direction { H, V };
+    // Natural size for the given extent; <= 0: none (GetMinSize() applies)
+    virtual int GetHeightForWidth(int /*width*/)  { return 0; }
+    virtual int GetWidthForHeight(int /*height*/) { return 0; }
+};
 
-    // Cross-axis alignment (secondary axis), both as a container default
-    // and per-item override via ItemRef::AlignSelf(...).
-    enum Align     { Auto,        // use container default (do not override)
-                     Stretch,     // fill cross-axis
-                     Start,       // align to start (top for H, left for V)
-                     Center,      // center on the cross-axis
-                     End };       // align to end (bottom for H, right for V)
+// Direction (H, V) and Align (Auto, Stretch, Start, Center, End) come from
+// FlowLayoutTypes, shared with the headless FlowLayoutSolver.
+class FlowBoxLayout : public ParentCtrl, public FlowLayoutTypes, public FlowConstraintSize {
+public:
+    typedef FlowBoxLayout CLASSNAME;
 
     // -------------------------------------------------------------------------
     // Item
     //
-    // Internal storage of one child’s layout state. Public facing API mutates
-    // these fields via ItemRef methods (Fixed / Fit / Expand / MinMax…).
+    // Ctrl-side state of one item. Its sizing spec (Fixed / Fit / Expand /
+    // MinMax… as set via ItemRef) lives in the solver as a FlowItemSpec with
+    // the same index; the solver’s FlowCell holds the per-pass result.
     // -------------------------------------------------------------------------
     struct Item : Moveable<Item> {
-        // --- Persistent API-facing state (sticks across passes) ---------------
-        Ctrl*  c               = nullptr;     // the child (nullptr => spacer/break)
-        int    fixed           = -1;          // >=0 => Fixed(px) on main axis
-        int    expandingWeight = 0;           // >0  => Expand(weight)
-        bool   fit             = false;       // true => Fit() on main axis
-        bool   is_break        = false;       // true => AddBreak semantics
-        int    minw            = -1;          // main-axis MIN cap  (if set >=0)
-        int    maxw            = 2048;        // main-axis MAX cap  (if set >=0)
-        int    minh            = -1;          // cross-axis MIN cap (if set >=0)
-        int    maxh            = INT_MAX;     // cross-axis MAX cap (if set >=0)
-        Align  align_self      = Align::Auto; // per-item cross-axis alignment
+        Ctrl*  c               = nullptr;     // the child (nullptr => spacer/break/virtual)
+
+        // --- Last commit (PostLayoutCommit only touches what changed) ---------
+        Rect   committed       = Null;        // rect last given to the Ctrl (Null = none)
+        Rect   committed_cell  = Null;        // cell last committed (damage tracking)
 
         // --- Persistent min-size cache (survives resizes/layouts) -------------
         Size   cachedMinSize   = Size(0,0);   // child’s cached GetMinSize
-        int    ms_epoch        = 0;           // last epoch when cache updated
-        bool   ms_valid        = false;       // quick guard for cache use
-
-        // --- Transient per-pass layout cache (reset each PreLayoutCalc) -------
-        struct TransientLayoutCache : Moveable<TransientLayoutCache> {
-            bool visible   = false;  // participates in this pass
-            bool spacer    = false;  // explicit spacer (AddSpacer)
-            bool breakMark = false;  // explicit hard wrap (AddBreak)
-            int  rowOrCol  = -1;     // row index (H) or position (V)
-            Rect cell;               // cell rect (before cross-axis align)
-            Rect content;            // final rect assigned to Ctrl
-        } cl;
+        int    ms_epoch        = 0;           // epoch of cachedMinSize (0 = invalid)
+
+        int    vslot           = -1;          // virtual mode: pool slot of the bound Ctrl
+        int    slot            = -1;          // slot map entry behind its Handle
+
+        // --- Size along the other axis (FlowConstraintSize) -------------------
+        FlowConstraintSize* sizer = nullptr;  // nullptr => min size only
+        bool   nested          = false;       // sizer is a FlowBoxLayout (arranged by us)
+        bool   filtered        = false;       // left out by SetFilter
+        bool   filter_hid      = false;       // ...and its child hidden for it
+        int    cs_at           = 0;           // constraint of cs_size (~height for widths)
+        int    cs_size         = 0;
+        int    cs_epoch        = 0;           // epoch of cs_size (0 = invalid)
 
         Item() {}
         Item(Ctrl& ctrl) : c(&ctrl) {}
     };
 
+    // -------------------------------------------------------------------------
+    // Handle
+    //
+    // Names an item across Insert/Remove/Move: a slot of the container's slot
+    // map plus the generation of that slot. Removing the item bumps the
+    // generation, so a stale handle resolves to -1 even once the slot is
+    // reused.
+    // -------------------------------------------------------------------------
+    struct Handle : Moveable<Handle> {
+        int slot = -1;
+        int gen  = 0;
+
+        bool IsNullInstance() const             { return slot < 0; }
+        bool operator==(const Handle& h) const  { return slot == h.slot && gen == h.gen; }
+        bool operator!=(const Handle& h) const  { return !(*this == h); }
+    };
+
     // -------------------------------------------------------------------------
     // ItemRef
     //
     // A tiny fluent handle returned by Add/AddFixed/... that lets you tune the
     // last inserted item (sizing mode, caps, alignment). Each call marks the
-    // layout “dirty” and triggers a Layout unless you paused it.
+    // layout “dirty” and triggers a Layout unless you paused it. It holds the
+    // item's Handle, so it stays on the item when others are inserted or
+    // removed before it, and does nothing once the item is gone.
     // -------------------------------------------------------------------------
     class ItemRef {
     public:
-        ItemRef(FlowBoxLayout* owner, int idx) : owner(owner), index(idx) {}
+        ItemRef(FlowBoxLayout* owner, int idx)
+        :   owner(owner), handle(owner ? owner->GetHandle(idx) : Handle()) {}
+
+        Handle GetHandle() const { return handle; }
+        int    GetIndex() const  { return owner ? owner->IndexOf(handle) : -1; }
 
         // Use the remaining space on the main axis. 'w' is a relative weight.
         // Example: A.Expand(1), B.Expand(2) -> B gets ~2× A’s share.
         ItemRef& Expand(int w=1) {
-            if(ok()) owner->items[index].expandingWeight = max(1, w);
-            if(owner) { owner->cur_gen++; if(owner->layout_pause == 0) owner->Layout(); }
+            if(ok()) { FlowItemSpec it = spec(); it.expandingWeight = max(1, w); set(it); }
+            touch();
             return *this;
         }
 
         // Take exactly 'px' on the main axis (never expands/shrinks).
         ItemRef& Fixed(int px) {
             if(ok()) {
-                auto& it = owner->items[index];
+                FlowItemSpec it = spec();
                 it.fixed = max(0, px);
                 it.expandingWeight = 0;
                 it.fit = false;
+                set(it);
             }
-            if(owner) { owner->cur_gen++; if(owner->layout_pause == 0) owner->Layout(); }
+            touch();
             return *this;
         }
 
@@ -150,43 +195,77 @@ public:
         // Good for labels/buttons/tiles that should not stretch.
         ItemRef& Fit() {
             if(ok()) {
-                auto& it = owner->items[index];
+                FlowItemSpec it = spec();
                 it.fit = true;
                 it.fixed = -1;
                 it.expandingWeight = 0;
+                set(it);
             }
-            if(owner) { owner->cur_gen++; if(owner->layout_pause == 0) owner->Layout(); }
+            touch();
             return *this;
         }
 
         // Hard caps (apply after the base main/cross size is chosen).
         // Use this to keep tiles/cards inside a fixed grid.
         ItemRef& MinMaxWidth(int minw = -1, int maxw = 2048) {
-            if(ok()) { auto& it = owner->items[index]; it.minw = minw; it.maxw = maxw; }
-            if(owner) { owner->cur_gen++; if(owner->layout_pause == 0) owner->Layout(); }
+            if(ok()) { FlowItemSpec it = spec(); it.minw = minw; it.maxw = maxw; set(it); }
+            touch();
             return *this;
         }
         ItemRef& MinMaxHeight(int minh = -1, int maxh = INT_MAX) {
-            if(ok()) { auto& it = owner->items[index]; it.minh = minh; it.maxh = maxh; }
-            if(owner) { owner->cur_gen++; if(owner->layout_pause == 0) owner->Layout(); }
+            if(ok()) { FlowItemSpec it = spec(); it.minh = minh; it.maxh = maxh; set(it); }
+            touch();
             return *this;
         }
 
         // Override container cross-axis alignment for this item only.
         ItemRef& AlignSelf(Align a) {
-            if(ok()) owner->items[index].align_self = a;
-            if(owner) { owner->cur_gen++; if(owner->layout_pause == 0) owner->Layout(); }
+            if(ok()) { FlowItemSpec it = spec(); it.align_self = a; set(it); }
+            touch();
+            return *this;
+        }
+
+        // Size a Fit() item along the other axis through 's' (e.g. a helper
+        // measuring a stock Label's wrapped text); children that implement
+        // FlowConstraintSize themselves need nothing. nullptr detaches.
+        ItemRef& ConstraintSize(FlowConstraintSize* s) {
+            if(ok()) owner->SetConstraintSize(GetIndex(), s);
+            touch();
             return *this;
         }
 
     private:
-        bool ok() const { return owner && index >= 0 && index < owner->items.GetCount(); }
+        bool ok() const                     { return GetIndex() >= 0; }
+        FlowItemSpec spec() const           { return owner->solver.GetSpec(GetIndex()); }
+        void set(const FlowItemSpec& it)    { owner->solver.SetSpec(GetIndex(), it); }
+        void touch()                        { if(ok()) { owner->MarkDirty(GetIndex()); owner->Relayout(); } }
         FlowBoxLayout* owner = nullptr;
-        int            index = -1;
+        Handle         handle;
+    };
+
+    // -------------------------------------------------------------------------
+    // VirtualItem
+    //
+    // Size spec of one data-source item in virtual mode (see SetVirtual). The
+    // fields mirror what Add*/ItemRef would set for a real child; min_size
+    // stands in for the child’s GetMinSize.
+    // -------------------------------------------------------------------------
+    struct VirtualItem {
+        Size   min_size        = Size(0,0);   // intrinsic size used by Fit/base
+        int    fixed           = -1;          // >=0 => Fixed(px) on main axis
+        int    expandingWeight = 0;           // >0  => Expand(weight)
+        bool   fit             = true;        // true => Fit() on main axis
+        bool   is_break        = false;       // true => AddBreak semantics
+        bool   spacer          = false;       // true => AddSpacer semantics
+        int    minw            = -1;          // main-axis MIN cap
+        int    maxw            = 2048;        // main-axis MAX cap
+        int    minh            = -1;          // cross-axis MIN cap
+        int    maxh            = INT_MAX;     // cross-axis MAX cap
+        Align  align_self      = Align::Auto; // per-item cross-axis alignment
     };
 
     // Create a layout in a given direction. Starts transparent by default.
-    FlowBoxLayout(Direction d = V) : dir(d) { Transparent(); }
+    FlowBoxLayout(Direction d = V);
     virtual ~FlowBoxLayout() {}
 
     // -------------------------------------------------------------------------
@@ -196,65 +275,101 @@ public:
     // Change primary flow direction at runtime.
     // Use H for galleries/toolbars; V for stacked forms/sidebars.
     FlowBoxLayout& SetDirection(Direction d) {
-        dir = d; ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        dir = d; MarkDirtyAll(); NotifyParent(true); Relayout(); return *this;
     }
 
     // Set space between neighboring items (both axes). Great for card gutters.
     FlowBoxLayout& SetGap(int px) {
-        gap = max(0, px); ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        gap = max(0, px); MarkDirtyAll(); Relayout(); return *this;
     }
 
     // Set inner padding (inset) of the container – single value (all sides).
     FlowBoxLayout& SetInset(int wh) {
-        inset = Rect(wh, wh, wh, wh); ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        inset = Rect(wh, wh, wh, wh); MarkDirtyAll(); Relayout(); return *this;
     }
     // Set symmetric horizontal/vertical padding.
     FlowBoxLayout& SetInset(int w, int h) {
-        inset = Rect(w, h, w, h); ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        inset = Rect(w, h, w, h); MarkDirtyAll(); Relayout(); return *this;
     }
     // Set per-edge padding (l, t, r, b). Use for asymmetric layouts.
     FlowBoxLayout& SetInset(int l, int t, int r, int b) {
-        inset = Rect(l, t, r, b); ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        inset = Rect(l, t, r, b); MarkDirtyAll(); Relayout(); return *this;
     }
 
-    // Enable line wrapping (H mode). This turns the flow into multiple rows,
-    // respecting fixed/fitted widths and fixed-column caps. Ignored in V mode.
+    // Enable wrapping. In H mode this turns the flow into multiple rows,
+    // respecting fixed/fitted widths and fixed-column caps. In V mode items
+    // continue in a new column when the height is used up (AddBreak starts
+    // one): multi-column property sheets in one container. Columns are as
+    // wide as their widest item, or SetFixedColumn wide.
     FlowBoxLayout& SetWrap(bool on = true) {
-        wrap = on; ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        wrap = on; MarkDirtyAll(); NotifyParent(true); Relayout(); return *this;
     }
 
-    // Report a meaningful natural height for a given width (H+wrap):
+    // Report a meaningful natural height for a given width (H+wrap), or
+    // width for a given height (V+wrap: the columns needed):
     // when on, parents that query min-size/MeasureHeightForWidth get a height
     // that accounts for how many rows are needed at that width. Helpful when
     // the parent wants to decide whether to add a scrollbar.
+    // Nested in another FlowBoxLayout, a change inside reschedules the parent,
+    // which measures this flow (results cached per constraint) and lays it
+    // out in the same pass, so a subtree settles in one top-down layout.
     FlowBoxLayout& SetWrapAutoResize(bool on = true) {
-        wrap_auto_resize = on; return *this;
+        wrap_auto_resize = on; minsize_gen = -1; NotifyParent(true); return *this;
     }
 
     // When the container gets more vertical room than needed (H+wrap), grow the
     // **rows** to consume it (nice for dashboards where rows should “breathe”).
     // Turn this OFF if you prefer the parent to scroll instead.
     FlowBoxLayout& SetWrapRowsExpand(bool on = true) {
-        wrap_rows_expand = on; ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        wrap_rows_expand = on; MarkDirtyAll(); Relayout(); return *this;
     }
 
     // Cross-axis alignment default for all items that do not override it.
     // Stretch is good for tile/card grids; Start/Center/End for compact toolbars.
     FlowBoxLayout& SetAlignItems(Align a) {
-        align_items = a; ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        align_items = a; MarkDirtyAll(); Relayout(); return *this;
     }
 
     // HARD width cap for *every* non-break item (H mode). Great for building a
-    // masonry/“card column” style where each cell is a fixed column width and
-    // rows wrap naturally. Set to -1 to disable.
+    // “card column” style where each cell is a fixed column width and rows
+    // wrap naturally (see SetMasonry for columns). In V+wrap, the width of
+    // every column. Set to -1 to disable.
     FlowBoxLayout& SetFixedColumn(int px) {
-        fixed_column = (px >= 0 ? px : -1); ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        fixed_column = (px >= 0 ? px : -1); MarkDirtyAll(); Relayout(); return *this;
     }
 
     // HARD height cap for *every* item (V mode). Useful for list rows of a
     // uniform height. Set to -1 to disable.
     FlowBoxLayout& SetFixedRow(int px) {
-        fixed_row    = (px >= 0 ? px : -1); ++cur_gen; if(layout_pause==0) Layout(); return *this;
+        fixed_row    = (px >= 0 ? px : -1); MarkDirtyAll(); Relayout(); return *this;
+    }
+
+    // Masonry (H + wrap + SetFixedColumn): Pinterest-style boards. Items keep
+    // their own heights and each goes under the column that currently ends
+    // highest; AddBreak levels all columns, spacers take no room. Appending
+    // only places the new items. Children implementing FlowConstraintSize
+    // get their height at the column width.
+    FlowBoxLayout& SetMasonry(bool on = true) {
+        masonry = on; MarkDirtyAll(); Relayout(); return *this;
+    }
+
+    // Balanced wrap (H + wrap): keep the greedy number of rows but move the
+    // breaks so that the rows come out about equally full (a toolbar of 7
+    // that greedily wraps 6+1 becomes 4+3). Sections (runs between AddBreak)
+    // of more than max_items cells stay greedy. Balanced rows are rebuilt on
+    // every resize.
+    FlowBoxLayout& SetWrapBalance(bool on = true, int max_items = 1000) {
+        wrap_balance = on; wrap_balance_max = max_items; MarkDirtyAll(); Relayout(); return *this;
+    }
+
+    // Justified rows (H + wrap): photo galleries. Children keep the aspect
+    // ratio of their min size (e.g. the image size) and every row is scaled
+    // to fill the width, with breaks chosen to keep rows as close to
+    // target_h as possible overall; the last row and rows before AddBreak
+    // stay at most target_h high. Appending only re-places the last rows.
+    // -1 disables.
+    FlowBoxLayout& SetJustifiedRows(int target_h) {
+        justify_row = (target_h > 0 ? target_h : -1); MarkDirtyAll(); Relayout(); return *this;
     }
 
     // Toggle the debug overlay (draws inset, gaps, rows/cells). Handy during
@@ -269,51 +384,129 @@ public:
 
     // Add a child with default Expand(1) behavior on the main axis.
     ItemRef Add(Ctrl& c) {
-        ParentCtrl::Add(c); Item it(c); it.expandingWeight = 1; items.Add(it);
-        ++cur_gen; if(layout_pause==0) Layout(); return ItemRef(this, items.GetCount()-1);
+        FlowItemSpec s; s.expandingWeight = 1;
+        AddItem(&c, s);
+        Relayout();
+        return ItemRef(this, items.GetCount()-1);
     }
 
     // Add a child with explicit Expand(weight).
     ItemRef AddExpand(Ctrl& c, int w=1) {
-        ParentCtrl::Add(c); Item it(c); it.expandingWeight = max(1,w); items.Add(it);
-        ++cur_gen; if(layout_pause==0) Layout(); return ItemRef(this, items.GetCount()-1);
+        FlowItemSpec s; s.expandingWeight = max(1,w);
+        AddItem(&c, s);
+        Relayout();
+        return ItemRef(this, items.GetCount()-1);
     }
 
     // Add a child with Fixed(px).
     ItemRef AddFixed(Ctrl& c, int px) {
-        ParentCtrl::Add(c); Item it(c); it.fixed = max(0,px); items.Add(it);
-        ++cur_gen; if(layout_pause==0) Layout(); return ItemRef(this, items.GetCount()-1);
+        FlowItemSpec s; s.fixed = max(0,px);
+        AddItem(&c, s);
+        Relayout();
+        return ItemRef(this, items.GetCount()-1);
     }
 
     // Add a child with Fit() on the main axis.
     ItemRef AddFit(Ctrl& c) {
-        ParentCtrl::Add(c); Item it(c); it.fit = true; items.Add(it);
-        ++cur_gen; if(layout_pause==0) Layout(); return ItemRef(this, items.GetCount()-1);
+        FlowItemSpec s; s.fit = true;
+        AddItem(&c, s);
+        Relayout();
+        return ItemRef(this, items.GetCount()-1);
     }
 
     // Add an *expanding spacer* (no child). In H without wrap, acts like a
     // fluid expander; with fixed-column/wrap, it occupies one cell.
     ItemRef AddSpacer(int weight = 1) {
-        Item it; it.c = nullptr; it.is_break = false;
-        it.expandingWeight = max(1, weight);
-        items.Add(it);
-        ++cur_gen; if(layout_pause==0) Layout();
+        FlowItemSpec s;
+        s.kind = FlowItemSpec::SPACER;
+        s.expandingWeight = max(1, weight);
+        AddItem(nullptr, s);
+        Relayout();
         return ItemRef(this, items.GetCount() - 1);
     }
 
     // Add a *hard break*.
     //  • wrap ON  (H): forces a new row; spacer weight is ignored.
     //  • wrap OFF (H): inserts a flexible gap (like an expander with given weight)
+    //  • wrap ON  (V): starts a new column.
     //  • V mode:   treated as a vertical spacer in the stack.
     ItemRef AddBreak(int spacer_expandingWeight = 1) {
-        Item it;
-        it.is_break = true;
-        it.expandingWeight = max(1, spacer_expandingWeight); // used only when wrap==false
-        items.Add(it);
-        ++cur_gen; if(layout_pause==0) Layout();
+        FlowItemSpec s;
+        s.kind = FlowItemSpec::BREAK;
+        s.expandingWeight = max(1, spacer_expandingWeight); // used only when wrap==false
+        AddItem(nullptr, s);
+        Relayout();
         return ItemRef(this, items.GetCount() - 1);
     }
 
+    // -------------------------------------------------------------------------
+    // Structural edits
+    //
+    // Only the rows from the first touched item on are planned again (H), or
+    // the cells below it are moved (V); rows past the edit that start with
+    // the same item as before are kept. Not available in virtual mode, where
+    // SetVirtualCount/InvalidateVirtual describe the data instead.
+    // -------------------------------------------------------------------------
+
+    // Insert a child at index 'at' (clamped) with default Expand(1), like Add.
+    // Its child order (tab order) follows the item order.
+    ItemRef Insert(int at, Ctrl& c);
+
+    // Remove the item (and its child from this control); a stale handle is
+    // ignored. Ctrl::Remove() stays available.
+    void    Remove(Handle h);
+    using   ParentCtrl::Remove;
+
+    // Move item 'from' so that it ends up at index 'to' (drag reorder). The
+    // child is moved too, so tab order follows the items; if it (or one of
+    // its children) had the focus, the focus is restored after the move.
+    void    Move(int from, int to);
+
+    // The handle of item i (Null when out of range or in virtual mode), the
+    // index of an item by handle or by child (-1 if not here), both O(1).
+    Handle  GetHandle(int i) const;
+    int     IndexOf(Handle h) const;
+    int     IndexOf(const Ctrl& c) const;
+
+    // -------------------------------------------------------------------------
+    // Keyed items (model-driven rebuilds)
+    //
+    // Reconcile makes the items those of 'keys', in that order (a repeated
+    // key counts once). A key of the previous call keeps its Ctrl, and the
+    // Ctrl keeps its cached min size. 'create' makes the Ctrl of a new key:
+    // heap-allocated, container-owned, sized like AddFit; a key it returns
+    // nullptr for is left out. The children follow the order of the keys
+    // (tab and focus order). Items whose keys are gone, and items not added
+    // by Reconcile, are removed; owned Ctrls are deleted. Then 'update'
+    // loads the model into the Ctrl of every key (call
+    // InvalidateMinSize(ctrl) there when that changes its size).
+    // Only the span between the unchanged leading and trailing items is
+    // rebuilt, followed by one incremental layout.
+    // -------------------------------------------------------------------------
+    FlowBoxLayout& Reconcile(const Vector<String>& keys, Function<Ctrl *(const String&)> create,
+                             Event<const String&, Ctrl&> update);
+
+    // Ctrl of 'key' from the last Reconcile, or nullptr.
+    Ctrl*   GetKeyCtrl(const String& key);
+
+    // -------------------------------------------------------------------------
+    // Filter (type-to-filter over many items)
+    //
+    // Items for which 'pass' returns false are left out of the layout. Their
+    // children stay, hidden, with their cached min sizes, and show again
+    // once they pass. Only the items whose outcome changes are touched, and
+    // the plan resumes from the first of them. Call RefreshFilter when the
+    // data behind 'pass' changes. 'pass' takes the item index: items added,
+    // removed or moved later are tested as they come, with the items whose
+    // index they shift.
+    // A filtered-out child is already hidden, so hiding it then is not seen:
+    // it shows again when it passes.
+    // -------------------------------------------------------------------------
+    FlowBoxLayout& SetFilter(Gate<int> pass);
+    FlowBoxLayout& RefreshFilter();
+    FlowBoxLayout& ClearFilter()              { filter.Clear(); return RefreshFilter(); }
+    bool           IsFilteredOut(int i) const { return i >= 0 && i < items.GetCount() && items[i].filtered; }
+
     // -------------------------------------------------------------------------
     // Batch edits / throttling
     // -------------------------------------------------------------------------
@@ -329,6 +522,49 @@ public:
         return *this;
     }
 
+    // Deferred layout (default): a mutation only marks the plan dirty and
+    // schedules one Layout() through the event loop, so building or editing
+    // many items costs a single pass. A pending pass also runs when the
+    // control is opened or shown (Paint never lays out). With deferred
+    // layout off, each mutation lays out immediately (unless paused).
+    //
+    // Behaviour change: before deferred layout, child rects and GetUsed*
+    // were current right after Add/Insert or a setter. Now they are only
+    // current once the pass ran. Code that reads them straight away should
+    // call FlushLayout() (FinishLayout() if progressive layout may be on),
+    // or turn deferred layout off.
+    FlowBoxLayout& SetDeferredLayout(bool on = true) {
+        deferred = on; if(!on) FlushLayout(); return *this;
+    }
+    bool IsDeferredLayout() const { return deferred; }
+
+    // Run a pending deferred Layout() now (e.g. before reading child rects);
+    // in progressive mode this is one pass, see FinishLayout().
+    FlowBoxLayout& FlushLayout() { if(layout_pending) Layout(); return *this; }
+    bool IsLayoutPending() const  { return layout_pending; }
+
+    // Progressive layout (very large containers): a pass spends about
+    // 'budget_ms' on children, then the run goes on in the next event-loop
+    // tick. Min sizes are queried in item order; children not reached yet
+    // stay out of the plan (or keep a stale size). The children in the viewport
+    // (see SetViewport) are moved first, the rest over the following ticks.
+    // A resize or item change mid-way replans at once (min sizes already
+    // queried are kept) and restarts the moves. Used sizes are provisional
+    // while IsLayoutProvisional(); FinishLayout() completes the run now.
+    FlowBoxLayout& SetProgressiveLayout(bool on = true, int budget_ms = 8) {
+        progressive = on; prog_budget = max(1, budget_ms); if(!on) FinishLayout(); return *this;
+    }
+    bool IsProgressiveLayout() const { return progressive; }
+    bool IsLayoutProvisional() const { return provisional; }
+    FlowBoxLayout& FinishLayout()    { if(layout_pending || provisional) LayoutPass(0); return *this; }
+
+    // Keep the plans of the last few sizes (default 4, within 4 MB): dragging
+    // a splitter back or toggling a side panel then only re-commits a stored
+    // plan. Any item or configuration change drops them. 0 turns it off.
+    FlowBoxLayout& SetPlanCache(int plans, int max_kb = 4096) {
+        solver.SetPlanCache(plans, max_kb); return *this;
+    }
+
     // RAII helper for Pause/Resume.
     struct PauseScope {
         FlowBoxLayout& L;
@@ -340,44 +576,91 @@ public:
     // Remove all items/children and reset internal book-keeping.
     FlowBoxLayout& ClearItems();
 
+    // -------------------------------------------------------------------------
+    // Virtual mode (data source instead of one Ctrl per item)
+    // -------------------------------------------------------------------------
+
+    // Drive the container from a data source. 'spec' describes item i, 'create'
+    // makes a fresh (heap-allocated, container-owned) Ctrl, and 'bind' loads
+    // item i into a Ctrl that is about to be shown. Only items intersecting the
+    // viewport get a Ctrl; Ctrls scrolled out of view are recycled. Replaces
+    // any existing items.
+    FlowBoxLayout& SetVirtual(int count, Event<int, VirtualItem&> spec,
+                              Function<Ctrl *()> create, Event<int, Ctrl&> bind);
+
+    // Change the item count (e.g. streaming appends). Existing specs are kept;
+    // new ones are queried from the provider.
+    FlowBoxLayout& SetVirtualCount(int count);
+
+    // Re-query the spec of item i (or of all items) and re-bind its Ctrl.
+    FlowBoxLayout& InvalidateVirtual(int i);
+    FlowBoxLayout& InvalidateVirtual();
+
+    // Visible region in container coordinates. By default it is derived from
+    // the visible part of the control on screen; set it explicitly when the
+    // host scrolls by other means. A Null rect restores the default.
+    FlowBoxLayout& SetViewport(const Rect& r);
+
+    // Extra margin (px) around the viewport that is realized ahead of time, so
+    // small scroll steps do not need new binds.
+    FlowBoxLayout& SetVirtualOverscan(int px) { virtual_overscan = max(0, px); SyncVirtual(); return *this; }
+
+    // Re-evaluate which items intersect the viewport and (re)bind Ctrls. Call
+    // after scrolling if the control’s position did not change.
+    void SyncVirtual();
+
+    bool  IsVirtual() const              { return virtual_mode; }
+    int   GetVirtualCount() const        { return virtual_mode ? items.GetCount() : 0; }
+    // Ctrl currently bound to item i, or nullptr when i is not realized.
+    Ctrl* GetVirtualCtrl(int i) const;
+
     // -------------------------------------------------------------------------
     // Introspection / diagnostics
     // -------------------------------------------------------------------------
 
     // Total used size after the last Layout (excludes inset). Handy to compute
-    // whether to enable a scrollbar in a parent.
+    // whether to enable a scrollbar in a parent. Call FlushLayout() first if
+    // a deferred pass may be pending.
     int  GetUsedWidth()  const { return used_w; }
     int  GetUsedHeight() const { return used_h; }
 
+    // Hit testing in this control's coordinates, against the current plan
+    // (a pending layout runs first): the item whose cell contains p (-1 if
+    // none), the items whose cells intersect r in index order (rubber-band
+    // selection, drop targets), the cell of item i (Null if hidden). Spacers
+    // and breaks are never hit. O(log n) via the solver's row index.
+    int  ItemAt(Point p) const;
+    void ItemsIn(const Rect& r, Vector<int>& items) const;
+    Rect GetItemRect(int i) const;
+
     // Human-readable summary (direction, wrap, counts, etc.).
     String ToString() const;
 
+    // The headless engine behind this control (specs, cells, row plan).
+    const FlowLayoutSolver& GetSolver() const { return solver; }
+
     // -------------------------------------------------------------------------
     // ParentCtrl overrides
     // -------------------------------------------------------------------------
     virtual void Layout() override;                 // perform layout pass
     virtual Size GetMinSize() const override;       // conservative natural size
     virtual void Paint(Draw& w) override;           // draws debug overlay when enabled
+    virtual void State(int reason) override;        // tracks scrolling in virtual mode
 
-    // Min-size cache invalidation (call when a child’s intrinsic min size changes)
+    // Min-size cache invalidation (call when a child’s intrinsic min size
+    // changes). Forwarded to an enclosing FlowBoxLayout only when this
+    // container’s own min size changes as a result.
     void InvalidateMinSize(Ctrl& c);
     void InvalidateAllMinSizes();
 
-private:
-    // Predicate: true if the item participates this pass (shown OR a break).
-    static inline bool IsItemVisible(const Item& it) {
-        return (it.c && it.c->IsShown()) || it.is_break;
-    }
-
-    // Clamp helper that respects “unset” (-1) semantics on min/max.
-    static int ClampWith(int minv, int maxv, int v) {
-        if(minv >= 0) v = max(v, minv);
-        if(maxv >= 0) v = min(v, maxv);
-        return v;
-    }
+    // FlowConstraintSize: an auto-resizing wrapped flow (H) reports its
+    // height at a width, a V one its width at a height; 0 otherwise.
+    virtual int GetHeightForWidth(int width) override;
+    virtual int GetWidthForHeight(int height) override;
 
+private:
     // Compute main-axis base size from the chosen mode.
-    static int basePrimary(const Item& it, const Size& ms, bool vertical) {
+    static int basePrimary(const FlowItemSpec& it, const Size& ms, bool vertical) {
         if(it.fixed >= 0) return it.fixed;
         if(it.fit)       return vertical ? ms.cy : ms.cx;
         return vertical ? ms.cy : ms.cx; // default to min-size on main axis
@@ -386,13 +669,26 @@ private:
     // -------------------------------------------------------------------------
     // Implementation pipeline
     // -------------------------------------------------------------------------
-    void PreLayoutCalc(const Rect& inner_rc);
-    void LayoutHorizontal(const Rect& irc, int inner_w, int inner_h, int visible_semantic);
-    void LayoutVertical  (const Rect& irc, int inner_w, int inner_h, int visible_semantic);
-
-    void PostLayoutCommit();
+    // One pass of Layout(); a budget (ms, 0 = none) makes it progressive.
+    // With a deadline, PreLayoutCalc holds out the children it did not get
+    // to measure and PostLayoutCommit commits the viewport first.
+    void LayoutPass(int budget_ms);
+    void PreLayoutCalc(const Rect& inner_rc, int deadline = INT_MAX);
+    void SyncSpec(int i, const FlowLayoutConfig& cfg);
+    FlowLayoutConfig GetConfig() const;
+
+    Rect PostLayoutCommit(int deadline = INT_MAX);
+    void CommitItem(int i, Rect& damage);
+    void CommitVirtual(Rect& damage);
+    static void CommitCell(Item& it, const FlowCell& cl, Rect& damage);
+    Rect GetVirtualViewport() const;
+    void LoadVirtualSpec(int i);
     void DebugPaint(Draw& w, const Rect& inner_rc) const;
 
+    // Used size for an inner rect, planned in the solver’s probe: does not
+    // disturb the committed plan (see FlowLayoutSolver::Measure).
+    Size Measure(const Rect& inner_rc);
+
     // Helper for parents: compute natural height for a given width (respects
     // wrapping and fixed columns). Used when SetWrapAutoResize(true).
     int MeasureHeightForWidth(int width);
@@ -400,9 +696,79 @@ private:
     // Central helper to fetch (and cache) a child’s min size.
     inline Size GetCtrlMinSize(Item& it);
 
+    // Same for the FlowConstraintSize answers (solver callbacks).
+    int  GetCtrlConstraintSize(int i, int at, bool height);
+    void SetConstraintSize(int i, FlowConstraintSize* s);
+
+    // Uncached GetMinSize (see minsize_cache) and its upward propagation.
+    Size ComputeMinSize();
+    void PropagateMinSize(Size before);
+
+    enum { TIMEID_LAYOUT = Ctrl::TIMEID_COUNT, TIMEID_PROGRESS, TIMEID_COUNT };
+
+    // Lay out after a mutation: now, or scheduled when deferred; nothing
+    // while paused.
+    void Relayout();
+
+    // Append an item (c == nullptr: spacer/break/virtual) with spec s.
+    void AddItem(Ctrl* c, FlowItemSpec s = FlowItemSpec()) { InsertItem(items.GetCount(), c, s); }
+    void InsertItem(int at, Ctrl* c, FlowItemSpec s);
+
+    // Ctrl side of a new item (slot, FlowConstraintSize); sets s.hfw.
+    void SetupItem(Item& it, Ctrl* c, FlowItemSpec& s);
+
+    // Test item i against the filter; hides or shows its child on a change.
+    void ApplyFilter(int i);
+    void ApplyFilter(int lo, int hi);  // items [lo, hi), if there is a filter
+
+    // Children shown or hidden through Ctrl::Show replan their item: a Ctrl
+    // state hook (installed once) hands SHOW to the parent flow, which finds
+    // the item through ctrl_slot.
+    static bool ChildStateHook(Ctrl* c, int reason);
+    void ChildShown(Ctrl& c);
+
+    // Add c as a child before the child of the first item from 'at' on that
+    // has one, so that the child order follows the item order.
+    void AddChildAt(Ctrl* c, int at);
+
+    // Slot map behind Handle: a free slot (or a new one), freeing bumps its
+    // generation; Reindex points the slots of items [from, to) back at them.
+    int  AllocSlot();
+    void FreeSlot(int slot);
+    void Reindex(int from, int to);
+
+    // Dirty tracking: item-level changes extend the solver’s dirty range so
+    // the next plan can resume from the first affected row; container-level
+    // changes force a full replan.
+    void MarkDirty(int i)  { solver.Invalidate(i); ++cur_gen; NotifyParent(); }
+    void MarkDirtyAll()    { solver.InvalidateAll(); ++cur_gen; NotifyParent(); }
+
+    // Nested flows (measure/arrange protocol): a parent FlowBoxLayout asks an
+    // auto-resizing child for its size along the other axis, so a change in
+    // the child invalidates the parent’s plan for it (once until the parent
+    // measures again) and schedules the parent, which arranges the child.
+    // 'always': the answer itself may have appeared or gone (direction, wrap).
+    void NotifyParent(bool always = false);
+
 private:
-    // Items in visual order.
-    Vector<Item> items;
+    // Items in visual order (Ctrl side) and the layout engine holding their
+    // specs and results under the same indices.
+    Vector<Item>     items;
+    FlowLayoutSolver solver;
+
+    // Slot map: item index and generation of each slot, the free slots, and
+    // the slot of each child
+    Vector<int>           slot_item;   // -1 = free
+    Vector<int>           slot_gen;
+    Vector<int>           slot_free;
+    VectorMap<Ctrl*, int> ctrl_slot;
+
+    // Ctrls made by Reconcile, by key (owned)
+    VectorMap<String, One<Ctrl>> keyed;
+
+    // Filter (SetFilter); own_show mutes ChildShown while it shows/hides
+    Gate<int>             filter;
+    bool                  own_show = false;
 
     // Container configuration
     Direction    dir   = V;
@@ -416,13 +782,38 @@ private:
     int          used_w = 0, used_h = 0;
 
     // Throttling
-    int          layout_pause = 0;
+    int          layout_pause   = 0;
+    bool         deferred       = true;   // see SetDeferredLayout
+    bool         layout_pending = false;  // a deferred Layout() is scheduled
+
+    // Progressive layout (SetProgressiveLayout)
+    bool         progressive  = false;
+    int          prog_budget  = 8;        // ms per pass
+    int          prog_next    = INT_MAX;  // first child held out of the plan (INT_MAX = none)
+    int          prog_commit  = INT_MAX;  // next item to commit (INT_MAX = all done)
+    bool         provisional  = false;    // the run is not done yet
+    Vector<int>  vp_items;                // scratch: items in the viewport (also CommitVirtual)
 
     // Min-size cache epoching
     int          minsize_epoch = 1;
 
+    // Measure results by inner size, valid for one generation and epoch.
+    // A parent probes a nested flow at a few constraints per pass at most.
+    struct MeasureEntry { Size inner = Null; Size used; };
+    MeasureEntry measure_cache[4];
+    int          measure_gen     = -1;
+    int          measure_epoch   = 0;
+    int          measure_next    = 0;
+    bool         parent_notified = false;  // see NotifyParent
+
+    // Aggregate GetMinSize, valid while generation, epoch and (for
+    // height-for-width) the width it was measured at are unchanged
+    mutable Size minsize_cache = Null;
+    mutable int  minsize_gen   = -1;
+    mutable int  minsize_key_epoch = 0;
+    mutable int  minsize_width = 0;
+
     // Planning guards (avoid redundant work)
-    Size         plan_inner = Size(0,0);
     int          plan_gen   = 0;
     int          cur_gen    = 0;
 
@@ -432,9 +823,23 @@ private:
     // Global caps (container-wide)
     int          fixed_column = -1; // H: cap width of all non-break items
     int          fixed_row    = -1; // V: cap height of all non-break items
+    bool         masonry      = false; // H+wrap+fixed_column: columns (SetMasonry)
+    bool         wrap_balance = false; // H+wrap: even rows (SetWrapBalance)
+    int          wrap_balance_max = 1000; // larger sections stay greedy
+    int          justify_row  = -1; // H+wrap: target row height (SetJustifiedRows)
 
     // Debug overlay flag
     bool  debug = false;
+
+    // Virtual mode: provider callbacks and the recycled Ctrl pool
+    bool                      virtual_mode     = false;
+    Event<int, VirtualItem&>  virtual_spec;
+    Function<Ctrl *()>        virtual_create;
+    Event<int, Ctrl&>         virtual_bind;
+    Array<Ctrl>               vpool;           // owned, recycled Ctrls
+    Vector<int>               vpool_item;      // item bound to vpool[k] (-1 = free)
+    Rect                      viewport         = Null;
+    int                       virtual_overscan = 0;
 };
 
 } // namespace Upp
@@ -0,0 +1,2099 @@
+#include "FlowLayoutSolver.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FLOW_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLOW_SSE2
+#endif
+
+namespace Upp {
+
+int FlowLayoutSolver::Add(const FlowItemSpec& s) {
+    const int i = GetCount();
+    SetCount(i + 1);
+    Store(i, s);
+    return i;
+}
+
+void FlowLayoutSolver::SetCount(int n) {
+    n = max(0, n);
+    const int count = GetCount();
+    if(n == count) return;
+    Invalidate(min(n, count));
+    Invalidate(max(n, count) - 1);
+    for(int i = n; i < count; ++i)
+        if(item_caps[i] >= 0)
+            caps_free.Add(item_caps[i]);
+    // the widest cell of a stack may go (ResumeVertical then scans again)
+    if(n < count)
+        plan.used_w = probe.used_w = -1;
+    item_flags.SetCount(n, FlowItemSpec::CONTENT | F_VISIBLE);
+    item_fixed.SetCount(n, -1);
+    item_weight.SetCount(n, 0);
+    item_min.SetCount(n, Size(0,0));
+    item_caps.SetCount(n, -1);
+    plan.cells.SetCount(n);
+    if(probe.cells.GetCount())
+        probe.cells.SetCount(n);
+}
+
+void FlowLayoutSolver::Insert(int i, const FlowItemSpec& s, int count) {
+    if(count <= 0) return;
+    i = minmax(i, 0, GetCount());
+    item_flags.Insert(i, 0, count);
+    item_fixed.Insert(i, -1, count);
+    item_weight.Insert(i, 0, count);
+    item_min.Insert(i, Size(0,0), count);
+    item_caps.Insert(i, -1, count);
+    for(int k = i; k < i + count; ++k)
+        Store(k, s);
+    plan.cells.InsertN(i, count);
+    if(probe.cells.GetCount())
+        probe.cells.InsertN(i, count);
+    ShiftItems(plan, i, count);
+    ShiftItems(probe, i, count);
+    Invalidate(i);
+    Invalidate(i + count - 1);
+}
+
+void FlowLayoutSolver::Remove(int i, int count) {
+    count = min(count, GetCount() - i);
+    if(i < 0 || count <= 0) return;
+    for(int k = i; k < i + count; ++k)
+        if(item_caps[k] >= 0)
+            caps_free.Add(item_caps[k]);
+    // the widest cell of a stack may go (ResumeVertical then scans again)
+    for(Plan* p : { &plan, &probe })
+        for(int k = i; k < min(i + count, p->cells.GetCount()); ++k)
+            if(p->cells[k].visible && IsContent(k) && p->cells[k].content.GetWidth() >= p->used_w)
+                p->used_w = -1;
+    item_flags.Remove(i, count);
+    item_fixed.Remove(i, count);
+    item_weight.Remove(i, count);
+    item_min.Remove(i, count);
+    item_caps.Remove(i, count);
+    plan.cells.Remove(i, count);
+    if(probe.cells.GetCount())
+        probe.cells.Remove(i, count);
+    ShiftItems(plan, i, -count);
+    ShiftItems(probe, i, -count);
+    Invalidate(i);
+}
+
+void FlowLayoutSolver::Move(int from, int to) {
+    const int n = GetCount();
+    if(from < 0 || from >= n) return;
+    to = minmax(to, 0, n - 1);
+    if(from == to) return;
+    // items in between shift by one: only [min, max] changes places
+    auto move = [&](auto& v) {
+        auto x = v[from];
+        v.Remove(from);
+        v.Insert(to, x);
+    };
+    move(item_flags);
+    move(item_fixed);
+    move(item_weight);
+    move(item_min);
+    move(item_caps);
+    move(plan.cells);
+    if(probe.cells.GetCount())
+        move(probe.cells);
+    Invalidate(min(from, to));
+    Invalidate(max(from, to));
+}
+
+// Items from i on moved by delta: inserted at i (delta > 0) or [i, i - delta)
+// removed. The cells already moved with their items; the dirty range and
+// the row starts follow them, so that LayoutHorizontal finds the rows past
+// the edit that start with the same item as before. Rows that started with
+// a removed item now start at i, where nothing is kept anyway.
+void FlowLayoutSolver::ShiftItems(Plan& p, int i, int delta) {
+    auto shift = [&](int& x) {
+        if(x >= i) x = max(i, x + delta);
+    };
+    if(p.dirty_hi >= 0)
+        shift(p.dirty_hi);
+    if(p.dirty_lo < INT_MAX)
+        shift(p.dirty_lo);
+    for(int& x : p.row_first)
+        shift(x);
+    if(p.row_first.GetCount())
+        p.row_first[0] = 0;            // the first row takes what lands before it
+    // a grid places items by index: every slot past i changes
+    if(p.grid_cols > 0 && i < GetCount())
+        p.Invalidate(GetCount() - 1);
+}
+
+void FlowLayoutSolver::Clear() {
+    item_flags.Clear();
+    item_fixed.Clear();
+    item_weight.Clear();
+    item_min.Clear();
+    item_caps.Clear();
+    caps.Clear();
+    caps_free.Clear();
+    plan.cells.Clear();
+    probe.cells.Clear();
+    saved.Clear();
+    plan.used_w = plan.used_h = 0;
+    InvalidateAll();
+}
+
+void FlowLayoutSolver::Store(int i, const FlowItemSpec& s) {
+    item_flags[i]  = byte((s.kind & F_KIND) | (s.visible ? F_VISIBLE : 0) | (s.fit ? F_FIT : 0) |
+                          (s.hfw ? F_HFW : 0) | (s.align_self << F_ALIGN_SHIFT));
+    item_fixed[i]  = s.fixed;
+    item_weight[i] = s.expandingWeight;
+    item_min[i]    = s.min_size;
+
+    Caps cp;
+    cp.minw = s.minw; cp.maxw = s.maxw;
+    cp.minh = s.minh; cp.maxh = s.maxh;
+    int& k = item_caps[i];
+    if(cp.IsDefault()) {
+        if(k >= 0) caps_free.Add(k);
+        k = -1;
+        return;
+    }
+    if(k < 0) {
+        if(caps_free.GetCount()) k = caps_free.Pop();
+        else { k = caps.GetCount(); caps.Add(); }
+    }
+    caps[k] = cp;
+}
+
+FlowItemSpec FlowLayoutSolver::GetSpec(int i) const {
+    FlowItemSpec s;
+    s.kind            = byte(Kind(i));
+    s.visible         = IsVisible(i);
+    s.fit             = Fit(i);
+    s.hfw             = IsHfw(i);
+    s.fixed           = item_fixed[i];
+    s.expandingWeight = item_weight[i];
+    const Caps& cp    = CapsOf(i);
+    s.minw = cp.minw; s.maxw = cp.maxw;
+    s.minh = cp.minh; s.maxh = cp.maxh;
+    s.align_self      = AlignSelf(i);
+    s.min_size        = item_min[i];
+    return s;
+}
+
+void FlowLayoutSolver::SetSpec(int i, const FlowItemSpec& s) {
+    const byte flags = item_flags[i];
+    const int  fixed = item_fixed[i], weight = item_weight[i], k = item_caps[i];
+    const Size ms = item_min[i];
+    const Caps cp = CapsOf(i);
+    Store(i, s);
+    const Caps& ncp = CapsOf(i);
+    if(flags != item_flags[i] || fixed != item_fixed[i] || weight != item_weight[i] ||
+       ms != item_min[i] || (k < 0) != (item_caps[i] < 0) ||
+       cp.minw != ncp.minw || cp.maxw != ncp.maxw || cp.minh != ncp.minh || cp.maxh != ncp.maxh)
+        Invalidate(i);
+}
+
+void FlowLayoutSolver::SetVisible(int i, bool v) {
+    if(IsVisible(i) == v) return;
+    item_flags[i] ^= F_VISIBLE;
+    Invalidate(i);
+}
+
+void FlowLayoutSolver::SetMinSize(int i, Size sz) {
+    if(item_min[i] == sz) return;
+    item_min[i] = sz;
+    Invalidate(i);
+}
+
+bool FlowLayoutSolver::CanResume(const FlowLayoutConfig& c, Size inner) const {
+    return !plan.dirty_all && plan.dirty_lo < INT_MAX && plan.inner == inner && plan.cfg == c;
+}
+
+bool FlowLayoutSolver::MarkItem(int i) {
+    FlowCell& cl = plan.cells[i];
+    cl = FlowCell();
+    const int kind = Kind(i);
+    if(kind == FlowItemSpec::CONTENT && !IsVisible(i)) return false;
+    cl.visible = true;
+    cl.spacer  = (kind == FlowItemSpec::SPACER);
+    return true;
+}
+
+int FlowLayoutSolver::GetScratchCapacity() const {
+    int columns = plan.col_bottom.GetAlloc() + plan.col_items.GetAlloc();
+    for(const Vector<int>& col : plan.col_items)
+        columns += col.GetAlloc();
+    return columns + scratch.cells.GetAlloc() + scratch.cell_at.GetAlloc() +
+           scratch.gaps.GetAlloc() + scratch.gap_at.GetAlloc() +
+           scratch.row_first.GetAlloc() + scratch.row_h_base.GetAlloc() +
+           scratch.row_h_final.GetAlloc() + scratch.row_top.GetAlloc() +
+           scratch.row_h.GetAlloc() + scratch.row_w.GetAlloc() +
+           scratch.row_fit.GetAlloc() + scratch.row_brk.GetAlloc() +
+           scratch.row_exp.GetAlloc() +
+           scratch.exp_idx.GetAlloc() + scratch.tail.GetAlloc() +
+           scratch.exp_size.GetAlloc() + scratch.exp_weight.GetAlloc() +
+           scratch.exp_min.GetAlloc() + scratch.exp_max.GetAlloc() +
+           scratch.exp_order.GetAlloc() +
+           scratch.stack.GetAlloc() + scratch.heap.GetAlloc() +
+           scratch.bal_pos.GetAlloc() + scratch.bal_prev.GetAlloc() + scratch.bal_rows.GetAlloc() +
+           scratch.bal_x.GetAlloc() + scratch.bal_cost.GetAlloc() +
+           plan.row_first.GetAlloc() + plan.row_top.GetAlloc() +
+           plan.row_h.GetAlloc() + plan.row_w.GetAlloc() +
+           plan.row_fit.GetAlloc() + plan.row_brk.GetAlloc() + plan.row_exp.GetAlloc();
+}
+
+void FlowLayoutSolver::Solve(const FlowLayoutConfig& c, const Rect& irc) {
+    hits.valid = false;
+
+    // the inner rect moved: so does whatever of the plan is kept
+    if(!plan.dirty_all)
+        MoveOrigin(irc.TopLeft());
+
+    // nothing changed since the last plan at this size
+    if(plan.IsClean() && plan.inner == irc.GetSize() && plan.cfg == c)
+        return;
+
+    // back at an earlier size
+    if(AdoptSaved(c, irc))
+        return;
+
+    // a resize that keeps every row: only rows that share a remainder change
+    if(Reflow(c, irc))
+        return;
+    SavePlan();
+
+    // measure-then-arrange: the probe already holds this plan
+    if(AdoptProbe(c, irc))
+        return;
+
+    Replan(c, irc);
+}
+
+void FlowLayoutSolver::Replan(const FlowLayoutConfig& c, const Rect& irc) {
+    // buffers only ever grow (Trim keeps the allocation), so a changed
+    // capacity means this pass went to the heap
+    const int capacity = GetScratchCapacity();
+    SolvePass(c, irc);
+    if(GetScratchCapacity() != capacity)
+        ++scratch_allocs;
+}
+
+Size FlowLayoutSolver::Measure(const FlowLayoutConfig& c, const Rect& irc) {
+    // the committed plan may already answer
+    if(plan.IsClean() && plan.cfg == c &&
+       (plan.width_free  || plan.inner.cx == irc.GetWidth()) &&
+       (plan.height_free || plan.inner.cy == irc.GetHeight()))
+        return Size(plan.used_w, plan.used_h);
+
+    Swap(plan, probe);
+    if(plan.cells.GetCount() != GetCount()) {   // first probe
+        plan.cells.SetCount(GetCount());
+        plan.dirty_all = true;
+    }
+    if(!plan.IsClean() || plan.inner != irc.GetSize() || plan.cfg != c)
+        if(!Reflow(c, irc))
+            Replan(c, irc);
+    const Size sz(plan.used_w, plan.used_h);
+    Swap(plan, probe);
+    return sz;
+}
+
+bool FlowLayoutSolver::AdoptProbe(const FlowLayoutConfig& c, const Rect& irc) {
+    if(!(probe.height_free || probe.width_free) || !probe.IsClean() || probe.cfg != c ||
+       !(probe.width_free  || probe.inner.cx == irc.GetWidth()) ||
+       !(probe.height_free || probe.inner.cy == irc.GetHeight()) ||
+       probe.cells.GetCount() != GetCount())
+        return false;
+
+    Swap(plan, probe);
+    plan.inner = irc.GetSize();
+    MoveOrigin(irc.TopLeft());         // the probe may have been planned elsewhere
+    return true;
+}
+
+void FlowLayoutSolver::MoveOrigin(Point origin) {
+    const Point d = origin - plan.origin;
+    if(!d.x && !d.y) return;
+    for(int i = 0; i < GetCount(); ++i) {
+        FlowCell& cl = plan.cells[i];
+        if(!cl.placed) continue;
+        cl.cell.Offset(d);
+        if(IsContent(i)) cl.content.Offset(d);
+    }
+    for(int& y : plan.row_top)
+        y += d.y;
+    for(int& y : plan.col_bottom)
+        y += d.y;
+    plan.v_bottom += d.y;
+    plan.origin = origin;
+}
+
+// -----------------------------------------------------------------------------
+// Plan cache
+//
+// Plans move between 'plan' and the cache by Swap, never by copy: the plan
+// being replaced is stored, and the pass that follows plans into the
+// buffers of the entry it evicted. Entries of another revision are dropped
+// as soon as they are seen.
+// -----------------------------------------------------------------------------
+int64 FlowLayoutSolver::Plan::GetBytes() const {
+    int64 columns = col_bottom.GetAlloc();
+    for(const Vector<int>& col : col_items)
+        columns += col.GetAlloc();
+    columns += jr_item.GetAlloc() + jr_sect.GetAlloc() + jr_prev.GetAlloc() + jr_row.GetAlloc() +
+               (jr_ar.GetAlloc() + jr_cost.GetAlloc()) * 2;
+    return (int64)cells.GetAlloc() * sizeof(FlowCell) +
+           (int64)(row_first.GetAlloc() + row_top.GetAlloc() + row_h.GetAlloc() +
+                   row_w.GetAlloc() + row_fit.GetAlloc() + row_brk.GetAlloc() +
+                   row_exp.GetAlloc() + columns) * sizeof(int);
+}
+
+void FlowLayoutSolver::SetPlanCache(int plans, int max_kb) {
+    saved_max    = max(0, plans);
+    saved_max_kb = max(0, max_kb);
+    saved.Clear();
+}
+
+bool FlowLayoutSolver::AdoptSaved(const FlowLayoutConfig& c, const Rect& irc) {
+    for(int k = saved.GetCount() - 1; k >= 0; --k)
+        if(saved[k].rev != rev)
+            saved.Remove(k);
+
+    int hit = -1;
+    for(int k = 0; k < saved.GetCount() && hit < 0; ++k)
+        if(saved[k].inner == irc.GetSize() && saved[k].cfg == c)
+            hit = k;
+    if(hit < 0) return false;
+
+    // the current plan takes the entry's place
+    const bool keep = plan.IsClean() && plan.cells.GetCount() == GetCount();
+    Swap(plan, saved[hit]);
+    if(keep) {
+        saved[hit].rev   = rev;
+        saved[hit].stamp = ++stamp;
+    }
+    else
+        saved.Remove(hit);
+    MoveOrigin(irc.TopLeft());
+    return true;
+}
+
+void FlowLayoutSolver::SavePlan() {
+    const int64 budget = (int64)saved_max_kb << 10;
+    if(saved_max <= 0 || !plan.IsClean() || plan.cells.GetCount() != GetCount() ||
+       plan.GetBytes() > budget)
+        return;
+
+    // least recently used entry goes first
+    auto Lru = [&] {
+        int k = 0;
+        for(int j = 1; j < saved.GetCount(); ++j)
+            if(saved[j].stamp < saved[k].stamp)
+                k = j;
+        return k;
+    };
+    int64 bytes = plan.GetBytes();
+    for(const Plan& p : saved)
+        bytes += p.GetBytes();
+    while(saved.GetCount() > 1 && (saved.GetCount() > saved_max || bytes > budget)) {
+        const int k = Lru();
+        bytes -= saved[k].GetBytes();
+        saved.Remove(k);
+    }
+
+    // store by swapping with the evicted entry (or an empty one)
+    const bool full = saved.GetCount() >= saved_max || bytes > budget;
+    Plan& p = full ? saved[Lru()] : saved.Add();
+    Swap(plan, p);
+    p.rev   = rev;
+    p.stamp = ++stamp;
+
+    plan.cells.SetCount(GetCount());
+    plan.dirty_all = true;
+}
+
+void FlowLayoutSolver::SolvePass(const FlowLayoutConfig& c, const Rect& irc) {
+    const int inner_w = max(0, irc.GetWidth());
+    const int inner_h = max(0, irc.GetHeight());
+
+    // only items changed since the last plan at this size: resume from the
+    // first affected row and keep the rest of the plan
+    if(CanResume(c, irc.GetSize())) {
+        // a grid stays a grid if the changed items qualify: only they move
+        if(plan.grid_cols > 0 && plan.cfg.dir == H) {
+            const int hi = min(plan.dirty_hi, GetCount() - 1);
+            bool grid = true;
+            for(int i = plan.dirty_lo; i <= hi && grid; ++i)
+                grid = IsGridItem(i);
+            if(grid) {
+                LayoutGrid(irc, plan.dirty_lo, hi, false);
+                ClearDirty();
+                return;
+            }
+        }
+        // masonry: items above the first changed one keep their columns
+        if(plan.mas_cols > 0) {
+            for(int i = plan.dirty_lo; i < GetCount(); ++i)
+                MarkItem(i);
+            LayoutMasonry(irc, plan.dirty_lo);
+            ClearDirty();
+            return;
+        }
+        if(IsJustifiedConfig(plan.cfg)) {
+            if(ResumeJustified(irc)) {
+                ClearDirty();
+                return;
+            }
+        }
+        else if(plan.cfg.dir == H ? ResumeHorizontal(irc, inner_w, inner_h)
+                                  : ResumeVertical  (irc, inner_w, inner_h)) {
+            ClearDirty();
+            return;
+        }
+    }
+
+    plan.cfg = c;
+    plan.inner = irc.GetSize();
+    plan.origin = irc.TopLeft();
+    plan.height_free = c.dir == H && c.wrap && !c.wrap_rows_expand;
+    plan.width_free  = c.dir == V && c.wrap;
+    plan.row_first.Trim(0);            // Trim keeps the allocation
+    plan.row_top.Trim(0);
+    plan.row_h.Trim(0);
+    plan.row_w.Trim(0);
+    plan.row_fit.Trim(0);
+    plan.row_brk.Trim(0);
+    plan.row_exp.Trim(0);
+    plan.rows_lo = 0;
+    plan.rows_hi = -1;
+    plan.v_flex = true;
+    plan.grid_cols = 0;
+    plan.mas_cols = 0;
+    plan.jr_count = 0;
+
+    plan.used_w = plan.used_h = 0;
+
+    // reset transient cache, mark visible
+    int visible_semantic = 0;
+    bool grid = IsGridConfig(c);
+    for(int i = 0; i < GetCount(); ++i) {
+        if(MarkItem(i))
+            ++visible_semantic;
+        grid = grid && IsGridItem(i);
+    }
+
+    if(visible_semantic == 0) {
+        plan.used_w = plan.used_h = 0;
+        ClearDirty();
+        return;
+    }
+
+    if(grid)
+        LayoutGrid(irc, 0, GetCount() - 1, true);
+    else if(IsMasonryConfig(c))
+        LayoutMasonry(irc, 0);
+    else if(IsJustifiedConfig(c))
+        LayoutJustified(irc, 0);
+    else if(plan.cfg.dir == H)
+        LayoutHorizontal(irc, inner_w, inner_h);
+    else if(plan.cfg.wrap)
+        LayoutColumns   (irc, inner_h);
+    else
+        LayoutVertical  (irc, inner_w, inner_h);
+
+    ClearDirty();
+}
+
+bool FlowLayoutSolver::ResumeHorizontal(const Rect& irc, int inner_w, int inner_h) {
+    if(plan.row_first.IsEmpty()) return false;
+    // growing rows share the extra height across every row, balanced ones
+    // the items of a section
+    if(plan.cfg.wrap && (plan.cfg.wrap_rows_expand || plan.cfg.wrap_balance)) return false;
+
+    // Resume at the last row that starts *before* the first dirty item: that
+    // row start (and every row above) depends only on unchanged items, while
+    // the row before a changed row-leader may now take it in.
+    const int r = max(0, FindLowerBound(plan.row_first, plan.dirty_lo) - 1);
+    plan.grid_cols = 0;
+
+    const int hi = min(plan.dirty_hi, GetCount() - 1);
+    int k = 0;
+    for(int i = plan.row_first[r]; i <= hi; ++i)
+        if(MarkItem(i))
+            ++k;
+    if(k == 0) return false;           // nothing visible: let the full pass decide
+
+    LayoutHorizontal(irc, inner_w, inner_h, r, plan.dirty_hi);
+    return true;
+}
+
+void FlowLayoutSolver::LayoutHorizontal(const Rect& irc, int inner_w, int inner_h,
+                                        int first_row, int stop_after) {
+    const int  gap          = plan.cfg.gap;
+    const bool wrap         = plan.cfg.wrap;
+    const int  fixed_column = plan.cfg.fixed_column;
+    const int  fixed_row    = plan.cfg.fixed_row;
+    const Align align_items = plan.cfg.align_items;
+
+    // rows [first_row, ...) are rebuilt; rows above are kept from the plan
+    const int p0 = (first_row > 0 ? plan.row_first[first_row] : 0);
+
+    // Rebuilt rows live in the scratch arena as flat arrays: row r owns
+    // cells [cell_at[r], cell_at[r + 1]) and gaps [gap_at[r], gap_at[r + 1]).
+    Vector<RowCell>& row_cells = scratch.cells;
+    Vector<GapExp>&  row_gaps  = scratch.gaps;
+    Vector<int>&     cell_at   = scratch.cell_at;
+    Vector<int>&     gap_at    = scratch.gap_at;
+    Vector<int>&     row_first = scratch.row_first; // first item index of each rebuilt row
+    Vector<int>&     row_fit   = scratch.row_fit;   // end of the furthest item kept in the row
+    Vector<int>&     row_brk   = scratch.row_brk;   // end the item that broke it would have had, or INT_MAX
+    row_cells.Trim(0);
+    row_gaps.Trim(0);
+    cell_at.Trim(0);
+    gap_at.Trim(0);
+    row_first.Trim(0);
+    row_fit.Trim(0);
+    row_brk.Trim(0);
+    cell_at.Add(0); gap_at.Add(0); row_first.Add(p0);
+    row_fit.Add(0); row_brk.Add(INT_MAX);
+
+    int x_row  = irc.left;
+    int placed = 0;
+    int keep_row = -1;  // previous-plan row from which the old plan is reused
+
+    auto row_open = [&] { // the current row already holds something
+        return row_cells.GetCount() > cell_at.Top() || row_gaps.GetCount() > gap_at.Top();
+    };
+
+    // Starts a new row at item p. Past the dirty range, a row that starts
+    // where the previous plan started one sees the same items as before, so
+    // the rest of the plan is still valid (returns false: stop building).
+    auto new_row = [&](int p) -> bool {
+        if(p > stop_after) {
+            const int r = FindLowerBound(plan.row_first, p);
+            if(r < plan.row_first.GetCount() && plan.row_first[r] == p) {
+                keep_row = r;
+                return false;
+            }
+        }
+        cell_at.Add(row_cells.GetCount());
+        gap_at.Add(row_gaps.GetCount());
+        row_first.Add(p);
+        row_fit.Add(0);
+        row_brk.Add(INT_MAX);
+        x_row  = irc.left;
+        placed = 0;
+        return true;
+    };
+
+    // Whether the row ends before an item that needs 'need' of it. The
+    // rows stay the same at any width in [max row_fit, min row_brk).
+    auto breaks = [&](int need) {
+        if(!row_open()) return false;
+        if(need <= inner_w) {
+            row_fit.Top() = max(row_fit.Top(), need);
+            return false;
+        }
+        row_brk.Top() = need;
+        return true;
+    };
+
+    // PASS 1: build rows (width base)
+    for(int i = p0; i < GetCount(); ++i) {
+        const Caps& cp = CapsOf(i);
+        FlowCell& cl = plan.cells[i];
+        if(!cl.visible) continue;
+
+        // wrap + break = newline marker
+        if(wrap && Kind(i) == FlowItemSpec::BREAK) {
+            cl.breakMark = true;
+            cl.rowOrCol  = first_row + row_first.GetCount() - 1;
+            if(row_open())
+                if(!new_row(i + 1)) break;
+            continue;
+        }
+
+        // fixed-column mode
+        if(fixed_column >= 0) {
+            const int cell_w = fixed_column;
+
+            if(!wrap && Kind(i) == FlowItemSpec::BREAK) {
+                RowCell rc; rc.idx=i; rc.is_ctrl=false; rc.w=cell_w; rc.hmin=cp.minh; rc.hmax=cp.maxh; rc.base_h=0;
+                if(placed > 0) x_row += gap;
+                cl.rowOrCol = first_row + row_first.GetCount() - 1;
+                row_cells.Add(rc);
+                x_row += cell_w; ++placed;
+                continue;
+            }
+            if(cl.spacer) {
+                if(wrap) {
+                    int need = (placed == 0 ? cell_w : (x_row - irc.left) + gap + cell_w);
+                    if(breaks(need))
+                        if(!new_row(i)) break;
+                }
+                RowCell rc; rc.idx=i; rc.is_ctrl=false; rc.w=cell_w; rc.hmin=cp.minh; rc.hmax=cp.maxh; rc.base_h=0;
+                if(placed > 0) x_row += gap;
+                cl.rowOrCol = first_row + row_first.GetCount() - 1;
+                row_cells.Add(rc);
+                x_row += cell_w; ++placed;
+                continue;
+            }
+
+            const Size ms = item_min[i];
+            if(wrap) {
+                int need = (placed==0 ? cell_w : (x_row - irc.left) + gap + cell_w);
+                if(breaks(need))
+                    if(!new_row(i)) break;
+            }
+            RowCell rc; rc.idx=i; rc.is_ctrl=true; rc.w=cell_w; rc.base_h=ms.cy; rc.hmin=cp.minh; rc.hmax=cp.maxh; rc.self_align=AlignSelf(i);
+            if(placed > 0) x_row += gap;
+            cl.rowOrCol = first_row + row_first.GetCount() - 1;
+            row_cells.Add(rc);
+            x_row += cell_w; ++placed;
+            continue;
+        }
+
+        // fluid mode
+        if(!wrap && Kind(i) == FlowItemSpec::BREAK) {
+            row_gaps.Add(GapExp{ i, 1, max(0, gap) });
+            cl.rowOrCol = first_row + row_first.GetCount() - 1;
+            continue;
+        }
+        if(cl.spacer) {
+            row_gaps.Add(GapExp{ i, max(1, item_weight[i]), 0 });
+            cl.rowOrCol = first_row + row_first.GetCount() - 1;
+            continue;
+        }
+
+        const Size ms = item_min[i];
+        const int base_w = RowBaseWidth(i, inner_h);
+
+        int candidate = (placed == 0 ? base_w : (x_row - irc.left) + gap + base_w);
+        if(wrap && base_w > 0) {
+            if(breaks(candidate)) {
+                if(!new_row(i)) break;
+                candidate = base_w;
+            }
+        }
+
+        RowCell rc; rc.idx=i; rc.is_ctrl=true; rc.w=base_w; rc.base_h=ms.cy; rc.hmin=cp.minh; rc.hmax=cp.maxh; rc.self_align=AlignSelf(i);
+        if(placed > 0) x_row += gap;
+        cl.rowOrCol = first_row + row_first.GetCount() - 1;
+        row_cells.Add(rc);
+        x_row += base_w; ++placed;
+    }
+
+    // close the last row
+    cell_at.Add(row_cells.GetCount());
+    gap_at.Add(row_gaps.GetCount());
+    const int nrows = row_first.GetCount();
+
+    if(wrap && plan.cfg.wrap_balance)
+        BalanceRows(first_row, inner_w);
+
+    // PASS 2A: base row heights
+    Vector<int>& row_h_base = scratch.row_h_base;
+    row_h_base.SetCount(nrows);
+    for(int r = 0; r < nrows; ++r) {
+        int row_h = 0;
+        for(int j = cell_at[r]; j < cell_at[r + 1]; ++j) {
+            const RowCell& rc = row_cells[j];
+            int ch = ClampWith(rc.hmin, rc.hmax, rc.base_h);
+            row_h = max(row_h, ch);
+        }
+        if(fixed_row >= 0) row_h = fixed_row;
+        if(!wrap && (align_items == Align::Stretch || align_items == Align::Auto))
+            row_h = inner_h;
+        row_h_base[r] = row_h;
+    }
+
+    // PASS 2B: optionally distribute extra height across wrapped rows
+    Vector<int>& row_h_final = scratch.row_h_final;
+    row_h_final.SetCount(nrows);
+    for(int r = 0; r < nrows; ++r)
+        row_h_final[r] = row_h_base[r];
+    const bool measuring = inner_h > 100000000; // treat huge heights as probes
+    
+    // reuse the existing switch: auto-resize implies “wrap rows expand”
+    if(wrap && plan.cfg.wrap_rows_expand && !measuring && nrows > 0) {
+
+        int base_total = 0;
+        for(int r = 0; r < nrows; ++r) base_total += row_h_base[r];
+        base_total += max(0, nrows - 1) * gap;
+
+        int extra = max(0, inner_h - base_total);
+        if(extra > 0) {
+            int each = extra / nrows;
+            int rem  = extra % nrows;
+            for(int r = 0; r < nrows; ++r)
+                row_h_final[r] += each + (r < rem ? 1 : 0);
+        }
+    }
+
+    // PASS 2C: expand widths within row + place cells
+    plan.used_w = plan.used_h = 0;
+    int y = irc.top;
+    if(first_row > 0) {
+        y = plan.row_top[first_row];
+        for(int r = 0; r < first_row; ++r)
+            plan.used_w = max(plan.used_w, plan.row_w[r]);
+        plan.used_h = (plan.row_top[first_row - 1] - irc.top) + plan.row_h[first_row - 1];
+    }
+
+    Vector<int>& row_top   = scratch.row_top;
+    Vector<int>& row_h_out = scratch.row_h;
+    Vector<int>& row_w     = scratch.row_w;
+    Vector<int>& row_exp   = scratch.row_exp;
+    row_top.SetCount(nrows);
+    row_h_out.SetCount(nrows);
+    row_w.SetCount(nrows);
+    row_exp.SetCount(nrows);
+
+    for(int r = 0; r < nrows; ++r) {
+        RowCell* R  = row_cells.begin() + cell_at[r];
+        GapExp*  GE = row_gaps.begin() + gap_at[r];
+        const int ncells = cell_at[r + 1] - cell_at[r];
+        const int ngaps  = gap_at[r + 1] - gap_at[r];
+        const int row_h  = row_h_final[r];
+        const int w = PlaceRow(R, ncells, GE, ngaps, irc, inner_w, y, row_h, first_row + r);
+
+        plan.used_w = max(plan.used_w, w);
+        plan.used_h = max(plan.used_h, (y - irc.top) + row_h);
+
+        row_top[r]   = y;
+        row_h_out[r] = row_h;
+        row_w[r]     = w;
+        row_exp[r]   = CountExpanders(R, ncells, ngaps);
+
+        y += row_h;
+        if(r + 1 < nrows) y += gap;
+    }
+
+    // Kept tail: same rows as before, moved by the height delta of the
+    // rebuilt ones
+    int dy = 0;
+    if(keep_row >= 0) {
+        dy = (y + gap) - plan.row_top[keep_row];
+        const int dr = first_row + nrows - keep_row;
+        if(dy || dr)
+            for(int i = plan.row_first[keep_row]; i < GetCount(); ++i) {
+                FlowCell& cl = plan.cells[i];
+                if(!cl.visible) continue;
+                cl.rowOrCol += dr;
+                if(!cl.placed) continue;
+                cl.cell.Offset(0, dy);
+                if(IsContent(i)) cl.content.Offset(0, dy);
+            }
+        const int last = plan.row_first.GetCount() - 1;
+        for(int r = keep_row; r <= last; ++r)
+            plan.used_w = max(plan.used_w, plan.row_w[r]);
+        plan.used_h = (plan.row_top[last] + dy - irc.top) + plan.row_h[last];
+    }
+
+    // splice the row plan: kept head | rebuilt rows | kept tail
+    auto splice = [&](Vector<int>& v, const Vector<int>& mid, int add) {
+        Vector<int>& tail = scratch.tail;
+        tail.Trim(0);
+        if(keep_row >= 0)
+            for(int r = keep_row; r < v.GetCount(); ++r)
+                tail.Add(v[r] + add);
+        v.Trim(first_row);
+        v.Append(mid);
+        v.Append(tail);
+    };
+    splice(plan.row_first, row_first, 0);
+    splice(plan.row_top,   row_top,   dy);
+    splice(plan.row_h,     row_h_out, 0);
+    splice(plan.row_w,     row_w,     0);
+    splice(plan.row_fit,   row_fit,   0);
+    splice(plan.row_brk,   row_brk,   0);
+    splice(plan.row_exp,   row_exp,   0);
+    UpdateRowsRange();
+}
+
+// PASS 2C of one row (cells R, gaps GE): shares out the width left over,
+// then writes the cells left to right. Returns the used width.
+int FlowLayoutSolver::PlaceRow(RowCell* R, int ncells, GapExp* GE, int ngaps,
+                               const Rect& irc, int inner_w, int y, int row_h, int row) {
+    const int gap          = plan.cfg.gap;
+    const int fixed_column = plan.cfg.fixed_column;
+
+    // provisional width
+    int sum_w = 0;
+    for(int i = 0; i < ncells; ++i) { if(i > 0) sum_w += gap; sum_w += R[i].w; }
+    for(int k = 0; k < ngaps; ++k)  { sum_w += gap; sum_w += GE[k].minw; }
+
+    int remainder = max(0, inner_w - sum_w);
+
+    // distribute width
+    if(fixed_column < 0 && remainder > 0) {
+        // controls and gaps/spacers (uncapped) share it in one go
+        Vector<int>& exp_idx = scratch.exp_idx;
+        exp_idx.Trim(0);
+        ClearExpand();
+        for(int i = 0; i < ncells; ++i) {
+            const RowCell& rc = R[i];
+            const int idx = rc.idx;
+            if(item_weight[idx] > 0) {
+                const Caps& cp = CapsOf(idx);
+                exp_idx.Add(i);
+                AddExpand(rc.w, max(1, item_weight[idx]), cp.minw, cp.maxw);
+            }
+        }
+        for(int k = 0; k < ngaps; ++k)
+            if(GE[k].weight > 0)
+                AddExpand(GE[k].minw, GE[k].weight, -1, -1);
+
+        if(scratch.exp_size.GetCount()) {
+            DistributeExpand(remainder);
+            const int nc = exp_idx.GetCount();
+            for(int k = 0; k < nc; ++k)
+                R[exp_idx[k]].w = scratch.exp_size[k];
+            for(int k = 0, e = nc; k < ngaps; ++k)
+                if(GE[k].weight > 0)
+                    GE[k].minw = scratch.exp_size[e++];
+        }
+    }
+
+    // place left→right
+    int x = irc.left;
+    int placed_in_row = 0;
+
+    for(int i = 0; i < ncells; ++i) {
+        RowCell& rc = R[i];
+        if(placed_in_row > 0) x += gap;
+        const int idx = rc.idx;
+        FlowCell& cl = plan.cells[rc.idx];
+
+        // write cell rect
+        cl.cell = Rect(x, y, x + rc.w, y + row_h);
+        cl.rowOrCol = row;
+        cl.placed = true;
+
+        // content rect
+        if(IsContent(idx))
+            cl.content = RowContent(idx, x, y, rc.w, row_h);
+        else
+            cl.content = Rect(0,0,0,0);
+
+        x += rc.w;
+        ++placed_in_row;
+    }
+    return x - irc.left;
+}
+
+// Cells and gaps of a row that share its remainder: 0 if the width of the
+// row does not change the cells in it
+int FlowLayoutSolver::CountExpanders(const RowCell* R, int ncells, int ngaps) const {
+    if(plan.cfg.fixed_column >= 0) return 0;
+    int n = ngaps;
+    for(int i = 0; i < ncells; ++i)
+        if(item_weight[R[i].idx] > 0)
+            ++n;
+    return n;
+}
+
+// PASS 1 width of fluid item i
+int FlowLayoutSolver::RowBaseWidth(int i, int inner_h) {
+    const Size ms = item_min[i];
+    int base_w;
+    if(item_fixed[i] >= 0)        base_w = item_fixed[i];
+    else if(Fit(i)) {
+        base_w = ms.cx;
+
+        // width-for-height (e.g. a V child that wraps & auto-resizes)
+        if(IsHfw(i) && WhenWidthForHeight) {
+            base_w = max(base_w, WhenWidthForHeight(i, inner_h));
+            plan.height_free = false;
+        }
+    }
+    else if(item_weight[i] > 0)   base_w = 0;
+    else                          base_w = ms.cx;
+
+    const Caps& cp = CapsOf(i);
+    return ClampWith(cp.minw, cp.maxw, base_w);
+}
+
+void FlowLayoutSolver::UpdateRowsRange() {
+    plan.rows_lo = 0;
+    plan.rows_hi = INT_MAX;
+    for(int r = 0; r < plan.row_fit.GetCount(); ++r) {
+        plan.rows_lo = max(plan.rows_lo, plan.row_fit[r]);
+        plan.rows_hi = min(plan.rows_hi, plan.row_brk[r] == INT_MAX ? INT_MAX : plan.row_brk[r] - 1);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Balanced wrap
+//
+// Runs after PASS 1 on the greedy rows. A section is a run of rows that
+// each end at a width break, closed by a row that does not. Its cells are
+// split again where PASS 1 could break: before any cell in fixed-column
+// mode, else before cells with a width (zero-width expanders stay with
+// the cell before). Rows [i, j) of the section, as cell positions, are
+//     width(i, j) = x[j] - x[i] - gap,    x[k] = sum of (w + gap) before k
+// wide, and cost[j] = min over i of cost[i] + (inner_w - width(i, j))^2
+// over the rows that fit (a row of one break-free run always does). Free
+// space costs quadratically, so splits that share it evenly win, and an
+// extra row (inner_w more free space) never pays off. Each position only
+// looks back over what one row can hold: O(items * items per row), which
+// wrap_balance_max bounds. When the program still ends with another row
+// count than greedy (e.g. greedy broke off a row of spacers only) the
+// section stays greedy.
+//
+// Balanced rows depend on the width as a whole, so they hold no Reflow
+// interval (row_brk 0).
+// -----------------------------------------------------------------------------
+void FlowLayoutSolver::BalanceRows(int first_row, int inner_w) {
+    const Vector<int>& row_brk = scratch.row_brk;
+    const int nrows = scratch.row_first.GetCount();
+    for(int r0 = 0; r0 < nrows; ) {
+        int r1 = r0;
+        while(r1 + 1 < nrows && row_brk[r1] != INT_MAX)
+            ++r1;
+        if(r1 > r0 && BalanceSection(r0, r1, inner_w))
+            for(int r = r0; r <= r1; ++r) {
+                scratch.row_brk[r] = 0;
+                for(int j = scratch.cell_at[r]; j < scratch.cell_at[r + 1]; ++j)
+                    plan.cells[scratch.cells[j].idx].rowOrCol = first_row + r;
+                for(int j = scratch.gap_at[r]; j < scratch.gap_at[r + 1]; ++j)
+                    plan.cells[scratch.gaps[j].idx].rowOrCol = first_row + r;
+            }
+        r0 = r1 + 1;
+    }
+}
+
+bool FlowLayoutSolver::BalanceSection(int r0, int r1, int inner_w) {
+    Vector<int>& cell_at = scratch.cell_at;
+    Vector<int>& gap_at  = scratch.gap_at;
+    const Vector<RowCell>& cells = scratch.cells;
+    const Vector<GapExp>&  gaps  = scratch.gaps;
+    const int c0 = cell_at[r0], c1 = cell_at[r1 + 1];
+    if(c1 - c0 > plan.cfg.wrap_balance_max)
+        return false;
+
+    // break points (cell positions), prefix widths
+    const int  gap   = plan.cfg.gap;
+    const bool fixed = plan.cfg.fixed_column >= 0;
+    Vector<int>&   pos = scratch.bal_pos;
+    Vector<int64>& x   = scratch.bal_x;
+    pos.Trim(0);
+    x.Trim(0);
+    int64 sum = 0;
+    for(int j = c0; j < c1; ++j) {
+        if(j == c0 || fixed || cells[j].w > 0) {
+            pos.Add(j);
+            x.Add(sum);
+        }
+        sum += cells[j].w + gap;
+    }
+    pos.Add(c1);
+    x.Add(sum);
+
+    const int np = pos.GetCount();
+    Vector<int64>& cost = scratch.bal_cost;
+    Vector<int>&   prev = scratch.bal_prev;
+    Vector<int>&   rows = scratch.bal_rows;
+    cost.SetCount(np);
+    prev.SetCount(np);
+    rows.SetCount(np);
+    cost[0] = 0;
+    rows[0] = 0;
+    for(int j = 1; j < np; ++j) {
+        cost[j] = -1;
+        for(int i = j - 1; i >= 0; --i) {
+            const int64 free = inner_w - (x[j] - x[i] - gap);
+            if(free < 0 && i < j - 1) break;
+            const int64 t = cost[i] + (free > 0 ? free * free : 0);
+            if(cost[j] < 0 || t < cost[j] || (t == cost[j] && rows[i] + 1 < rows[j])) {
+                cost[j] = t;
+                prev[j] = i;
+                rows[j] = rows[i] + 1;
+            }
+        }
+    }
+    const int nr = r1 - r0 + 1;
+    if(rows[np - 1] != nr)
+        return false;
+
+    // new cell splits; spacers go with the cells before them
+    for(int p = prev[np - 1], r = r1; r > r0; p = prev[p], --r)
+        cell_at[r] = pos[p];
+    int g = gap_at[r0];
+    for(int r = r0 + 1; r <= r1; ++r) {
+        const int idx = cells[cell_at[r]].idx;
+        while(g < gap_at[r1 + 1] && gaps[g].idx < idx)
+            ++g;
+        gap_at[r] = g;
+        scratch.row_first[r] = idx;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Reflow
+//
+// PASS 1 breaks a row before an item when the item would end past the
+// inner width, so a plan records, per row, the furthest an item it kept
+// ends (row_fit) and where the item that broke it would have ended
+// (row_brk). At any width in [max row_fit, min row_brk) PASS 1 builds the
+// same rows again, with the same heights: only the rows with expanders or
+// spacers (row_exp) see a different remainder. Reflow redoes PASS 2C for
+// those and leaves every other row and the row plan as they are.
+// -----------------------------------------------------------------------------
+bool FlowLayoutSolver::Reflow(const FlowLayoutConfig& c, const Rect& irc) {
+    const int inner_w = irc.GetWidth();
+    if(!plan.IsClean() || plan.cfg != c || !plan.height_free || plan.grid_cols > 0 ||
+       plan.cells.GetCount() != GetCount() || (plan.row_first.IsEmpty() && !plan.mas_cols) ||
+       inner_w < plan.rows_lo || inner_w > plan.rows_hi)
+        return false;
+
+    MoveOrigin(irc.TopLeft());
+    if(plan.mas_cols > 0) {            // same columns: only the full-width breaks change
+        for(int i = 0; i < GetCount(); ++i)
+            if(plan.cells[i].breakMark)
+                plan.cells[i].cell.right = irc.right;
+        plan.inner = irc.GetSize();
+        return true;
+    }
+    const int inner_h = max(0, irc.GetHeight());
+    const int nrows = plan.row_first.GetCount();
+    Vector<RowCell>& R  = scratch.cells;
+    Vector<GapExp>&  GE = scratch.gaps;
+    plan.used_w = 0;
+    for(int r = 0; r < nrows; ++r) {
+        if(plan.row_exp[r] > 0) {
+            R.Trim(0);
+            GE.Trim(0);
+            const int end = r + 1 < nrows ? plan.row_first[r + 1] : GetCount();
+            for(int i = plan.row_first[r]; i < end; ++i) {
+                const FlowCell& cl = plan.cells[i];
+                if(!cl.visible || cl.breakMark) continue;
+                if(cl.spacer) {
+                    GE.Add(GapExp{ i, max(1, item_weight[i]), 0 });
+                    continue;
+                }
+                RowCell& rc = R.Add();
+                rc.idx = i;
+                rc.w   = RowBaseWidth(i, inner_h);
+            }
+            plan.row_w[r] = PlaceRow(R.begin(), R.GetCount(), GE.begin(), GE.GetCount(),
+                                     irc, inner_w, plan.row_top[r], plan.row_h[r], r);
+        }
+        plan.used_w = max(plan.used_w, plan.row_w[r]);
+    }
+    plan.inner = irc.GetSize();
+    return true;
+}
+
+// Content rect of item i in a row cell (x, y, w, row_h).
+Rect FlowLayoutSolver::RowContent(int i, int x, int y, int w, int row_h) const {
+    // vertical (cross-axis)
+    const Size ms = item_min[i];
+    const Caps& cp = CapsOf(i);
+    int ch = ClampWith(cp.minh, cp.maxh, ms.cy);
+    Align va = EffAlign(i);
+    int topy = y;
+    if(va == Align::Center)      topy = y + (row_h - ch) / 2;
+    else if(va == Align::End)    topy = y + (row_h - ch);
+    else if(va == Align::Stretch || va == Align::Auto) { ch = ClampWith(cp.minh, cp.maxh, row_h); topy = y; }
+
+    // horizontal, within the cell
+    int cx = x, avail_w = w;
+    int natural_w;
+    if(item_fixed[i] >= 0)          natural_w = item_fixed[i];
+    else if(Fit(i))                 natural_w = ms.cx;
+    else if(item_weight[i] > 0)     natural_w = avail_w;
+    else                             natural_w = ms.cx;
+    natural_w = ClampWith(cp.minw, cp.maxw, natural_w);
+
+    Align ha = EffAlign(i);
+    int cw;
+    if(ha == Align::Stretch || ha == Align::Auto || item_weight[i] > 0) {
+        cw = avail_w;
+    } else {
+        cw = min(natural_w, avail_w);
+        if(ha == Align::Center) cx += (avail_w - cw)/2;
+        else if(ha == Align::End) cx += (avail_w - cw);
+    }
+    return Rect(cx, topy, cx + cw, topy + ch);
+}
+
+// -----------------------------------------------------------------------------
+// Uniform grid (H): with a fixed column and a fixed row every cell has the
+// same size, so item i goes to row i / cols and column i % cols, whatever
+// its min size. Matches what LayoutHorizontal computes for such items.
+// -----------------------------------------------------------------------------
+bool FlowLayoutSolver::IsGridConfig(const FlowLayoutConfig& c) const {
+    if(c.dir == V)
+        return c.fixed_row >= 0 && !c.wrap;
+    return c.wrap && !c.wrap_rows_expand && !c.masonry && c.justify_row <= 0 && !c.wrap_balance &&
+           c.fixed_column >= 0 && c.fixed_row >= 0 && c.fixed_column + c.gap > 0;
+}
+
+bool FlowLayoutSolver::IsGridItem(int i) const {
+    return IsContent(i) ? IsVisible(i) : plan.cfg.dir == V;
+}
+
+bool FlowLayoutSolver::UsesMinSize(const FlowLayoutConfig& c, int i) const {
+    if(!IsContent(i)) return false;
+    if(IsJustifiedConfig(c)) return true;
+    const Align a = (AlignSelf(i) != Auto) ? AlignSelf(i) : c.align_items;
+    if(a != Stretch && a != Auto) return true;
+    if(c.fixed_row < 0) return true;
+    return (c.dir == H || c.wrap) && c.fixed_column < 0;  // V + wrap: column widths
+}
+
+// Places items [lo, hi] (all of them when full) and updates the row plan and
+// used size, which depend on the item count only.
+void FlowLayoutSolver::LayoutGrid(const Rect& irc, int lo, int hi, bool full) {
+    if(plan.cfg.dir == V) {
+        // the stack is already uniform: keep its (per-item O(1)) pass
+        LayoutVertical(irc, max(0, irc.GetWidth()), max(0, irc.GetHeight()));
+        plan.grid_cols = 1;
+        plan.grid_cell = Size(irc.GetWidth(), plan.cfg.fixed_row);
+        return;
+    }
+
+    const int n   = GetCount();
+    const int gap = plan.cfg.gap;
+    const int cw  = plan.cfg.fixed_column;
+    const int rh  = plan.cfg.fixed_row;
+    const int inner_w = max(0, irc.GetWidth());
+    const int cols = (inner_w >= cw ? 1 + (inner_w - cw) / (cw + gap) : 1);
+    plan.grid_cols = cols;
+    plan.grid_cell = Size(cw, rh);
+
+    for(int i = lo; i <= hi; ++i) {
+        if(!full) MarkItem(i);
+        FlowCell& cl = plan.cells[i];
+        const int r = i / cols;
+        const int x = irc.left + i % cols * (cw + gap);
+        const int y = irc.top + r * (rh + gap);
+        cl.cell     = Rect(x, y, x + cw, y + rh);
+        cl.content  = RowContent(i, x, y, cw, rh);
+        cl.rowOrCol = r;
+        cl.placed   = true;
+    }
+
+    // rows: only the count and the width of the last one follow the changes
+    const int nrows = (n + cols - 1) / cols;
+    const int r0 = full ? 0 : max(0, min(plan.row_first.GetCount(), nrows) - 1);
+    plan.row_first.SetCount(nrows);
+    plan.row_top.SetCount(nrows);
+    plan.row_h.SetCount(nrows);
+    plan.row_w.SetCount(nrows);
+    plan.row_fit.SetCount(nrows);
+    plan.row_brk.SetCount(nrows);
+    plan.row_exp.SetCount(nrows);
+    for(int r = r0; r < nrows; ++r) {
+        const int k = min(cols, n - r * cols);
+        plan.row_first[r] = r * cols;
+        plan.row_top[r]   = irc.top + r * (rh + gap);
+        plan.row_h[r]     = rh;
+        plan.row_w[r]     = k * (cw + gap) - gap;
+        plan.row_fit[r]   = k > 1 ? plan.row_w[r] : 0;
+        plan.row_brk[r]   = r + 1 < nrows ? cols * (cw + gap) + cw : INT_MAX;
+        plan.row_exp[r]   = 0;
+    }
+    UpdateRowsRange();
+    plan.used_w = nrows ? plan.row_w[0] : 0;
+    plan.used_h = nrows ? nrows * (rh + gap) - gap : 0;
+}
+
+// -----------------------------------------------------------------------------
+// Masonry
+//
+// Columns of fixed_column width; the column bottoms (tops of their next
+// items) sit in a min-heap ordered by bottom, then index, so the column an
+// item goes to is the root, and placing it only sifts the root down. A
+// break sets every bottom to the longest and rebuilds the heap.
+//
+// Planning from item 'from' on starts from the column bottoms there: the
+// stored ones when only items were appended, else read back from the cells
+// above it (a scan, no sizing).
+// -----------------------------------------------------------------------------
+bool FlowLayoutSolver::IsMasonryConfig(const FlowLayoutConfig& c) const {
+    return c.dir == H && c.wrap && c.masonry && c.fixed_column >= 0 &&
+           c.fixed_column + c.gap > 0;
+}
+
+int FlowLayoutSolver::MasonryCellHeight(int i, int cw) {
+    if(plan.cfg.fixed_row >= 0)
+        return plan.cfg.fixed_row;
+    int h = item_min[i].cy;
+    if(IsHfw(i) && WhenHeightForWidth)
+        h = max(h, WhenHeightForWidth(i, cw));
+    const Caps& cp = CapsOf(i);
+    return ClampWith(cp.minh, cp.maxh, h);
+}
+
+void FlowLayoutSolver::LayoutMasonry(const Rect& irc, int from) {
+    const int n   = GetCount();
+    const int gap = plan.cfg.gap;
+    const int cw  = plan.cfg.fixed_column;
+    const int inner_w = max(0, irc.GetWidth());
+    const int cols = (inner_w >= cw ? 1 + (inner_w - cw) / (cw + gap) : 1);
+
+    Vector<int>& bottom = plan.col_bottom;
+    Vector< Vector<int> >& col_items = plan.col_items;
+    from = plan.mas_cols == cols ? min(from, n) : 0;
+    if(from == 0 || from != plan.mas_count) {
+        // column state above 'from'
+        bottom.SetCount(cols);
+        col_items.SetCount(cols);
+        for(int c = 0; c < cols; ++c) {
+            bottom[c] = irc.top;
+            col_items[c].Trim(0);
+        }
+        plan.used_h = 0;
+        for(int i = 0; i < from; ++i) {
+            const FlowCell& cl = plan.cells[i];
+            if(!cl.placed) continue;
+            if(cl.breakMark) {
+                for(int c = 0; c < cols; ++c)
+                    bottom[c] = cl.cell.top;
+                continue;
+            }
+            bottom[cl.rowOrCol] = cl.cell.bottom + gap;
+            col_items[cl.rowOrCol].Add(i);
+            plan.used_h = max(plan.used_h, cl.cell.bottom - irc.top);
+        }
+    }
+    plan.mas_cols  = cols;
+    plan.mas_count = n;
+    plan.height_free = true;
+
+    // min-heap of columns: the leftmost of the shortest on top
+    Vector<int>& heap = scratch.heap;
+    auto less = [&](int a, int b) {
+        return bottom[a] < bottom[b] || (bottom[a] == bottom[b] && a < b);
+    };
+    auto sift = [&](int k) {
+        for(;;) {
+            const int l = 2 * k + 1, r = l + 1;
+            int m = k;
+            if(l < cols && less(heap[l], heap[m])) m = l;
+            if(r < cols && less(heap[r], heap[m])) m = r;
+            if(m == k) return;
+            Swap(heap[k], heap[m]);
+            k = m;
+        }
+    };
+    auto heapify = [&] {
+        for(int k = cols / 2 - 1; k >= 0; --k)
+            sift(k);
+    };
+    heap.SetCount(cols);
+    for(int c = 0; c < cols; ++c)
+        heap[c] = c;
+    heapify();
+
+    for(int i = from; i < n; ++i) {
+        FlowCell& cl = plan.cells[i];
+        if(!cl.visible || cl.spacer) continue;
+
+        if(Kind(i) == FlowItemSpec::BREAK) {
+            int level = irc.top;
+            for(int c = 0; c < cols; ++c)
+                level = max(level, bottom[c]);
+            for(int c = 0; c < cols; ++c)
+                bottom[c] = level;
+            heapify();
+            cl.breakMark = true;
+            cl.cell      = Rect(irc.left, level, irc.right, level);
+            cl.content   = Rect(0,0,0,0);
+            cl.rowOrCol  = -1;
+            cl.placed    = true;
+            continue;
+        }
+
+        const int c = heap[0];
+        const int x = irc.left + c * (cw + gap);
+        const int y = bottom[c];
+        const int h = MasonryCellHeight(i, cw);
+        cl.cell     = Rect(x, y, x + cw, y + h);
+        cl.content  = RowContent(i, x, y, cw, h);
+        cl.rowOrCol = c;
+        cl.placed   = true;
+        col_items[c].Add(i);
+        bottom[c] = y + h + gap;
+        plan.used_h = max(plan.used_h, y + h - irc.top);
+        sift(0);
+    }
+
+    // columns are used from the left
+    int used = 0;
+    while(used < cols && col_items[used].GetCount())
+        ++used;
+    plan.used_w = used ? used * (cw + gap) - gap : 0;
+
+    // widths with the same column count
+    plan.rows_lo = cols > 1 ? cols * (cw + gap) - gap : 0;
+    plan.rows_hi = (cols + 1) * (cw + gap) - gap - 1;
+}
+
+// -----------------------------------------------------------------------------
+// Justified rows
+//
+// Photos [i, j) scaled to fill the inner width W as one row are
+// (W - (j - i - 1) * gap) / (ar[i] + ... + ar[j - 1]) high, which only
+// falls as the row takes more photos. cost[j], the least sum of squared
+// deviations from the target over rows breaking photos [0, j), is the
+// minimum of cost[i] + (height(i, j) - target)^2 over the starts i of a
+// last row: back from j - 1 while the row stays at least half the target
+// high (one photo always fits) and within the section. So every position
+// looks back a bounded number of photos and the program is linear.
+//
+// Rows ending a section (at a break or the last photo) only pay when they
+// are lower than the target, and are then not stretched past it. Appending
+// photos extends the program from the old last position (whose row may now
+// end a section or not); backtracking from the new end stops at the first
+// row start the old rows share, and only the rows after it are placed again.
+// -----------------------------------------------------------------------------
+bool FlowLayoutSolver::IsJustifiedConfig(const FlowLayoutConfig& c) const {
+    return c.dir == H && c.wrap && !c.masonry && c.justify_row > 0;
+}
+
+bool FlowLayoutSolver::ResumeJustified(const Rect& irc) {
+    // appended items only
+    if(plan.jr_count == 0 || plan.dirty_lo != plan.jr_count)
+        return false;
+    for(int i = plan.dirty_lo; i < GetCount(); ++i)
+        MarkItem(i);
+    LayoutJustified(irc, plan.jr_count);
+    return true;
+}
+
+void FlowLayoutSolver::LayoutJustified(const Rect& irc, int from) {
+    const int n       = GetCount();
+    const int gap     = plan.cfg.gap;
+    const int inner_w = max(0, irc.GetWidth());
+    const double target = plan.cfg.justify_row;
+
+    Vector<int>&    item = plan.jr_item;
+    Vector<double>& P    = plan.jr_ar;
+    Vector<int>&    sect = plan.jr_sect;
+    Vector<double>& cost = plan.jr_cost;
+    Vector<int>&    prev = plan.jr_prev;
+    Vector<int>&    row  = plan.jr_row;
+    if(from == 0) {
+        item.Trim(0);
+        sect.Trim(0);
+        row.Trim(0);
+        P.Trim(0);
+        cost.Trim(0);
+        prev.Trim(0);
+        P.Add(0);
+        cost.Add(0);
+        prev.Add(0);
+        plan.jr_sect_next = 0;
+        plan.row_first.Trim(0);
+        plan.row_top.Trim(0);
+        plan.row_h.Trim(0);
+        plan.row_w.Trim(0);
+    }
+    const int m0 = item.GetCount();
+
+    // new photos
+    for(int i = from; i < n; ++i) {
+        FlowCell& cl = plan.cells[i];
+        if(!cl.visible || cl.spacer) continue;
+        if(Kind(i) == FlowItemSpec::BREAK) {
+            cl.breakMark = true;
+            plan.jr_sect_next = item.GetCount();
+            continue;
+        }
+        const Size ms = item_min[i];
+        item.Add(i);
+        P.Add(P.Top() + (ms.cx > 0 && ms.cy > 0 ? (double)ms.cx / ms.cy : 1.0));
+        sect.Add(plan.jr_sect_next);
+    }
+    plan.jr_count = n;
+    plan.height_free = true;
+    const int m = item.GetCount();
+
+    auto height = [&](int i, int j) { return (inner_w - (j - i - 1) * gap) / (P[j] - P[i]); };
+    auto deviation = [&](double h, bool last) {
+        return last && h >= target ? 0.0 : (h - target) * (h - target);
+    };
+    // least cost of rows over [0, j) whose last row starts at *start
+    auto best = [&](int j, bool last, int* start) {
+        double c = -1;
+        for(int i = j - 1; i >= sect[j - 1]; --i) {
+            const double h = height(i, j);
+            if(i < j - 1 && h < target / 2) break;
+            const double t = cost[i] + deviation(h, last);
+            if(c < 0 || t < c) { c = t; *start = i; }
+        }
+        return c;
+    };
+    cost.SetCount(m + 1);
+    prev.SetCount(m + 1);
+    for(int j = max(1, m0); j <= m; ++j)
+        cost[j] = best(j, j < m && sect[j] == j, &prev[j]);
+
+    // rows from the end back to the first start the old rows share
+    Vector<int>& starts = scratch.tail;
+    starts.Trim(0);
+    int keep = 0;                      // old rows kept
+    if(m > 0) {
+        int s;
+        best(m, true, &s);
+        for(;;) {
+            starts.Add(s);
+            const int r = FindLowerBound(row, s);
+            if(s < m0 && r < row.GetCount() && row[r] == s) {
+                keep = r;
+                break;
+            }
+            if(s == 0) break;
+            s = prev[s];
+        }
+    }
+    const int nrows = keep + starts.GetCount();
+    row.SetCount(nrows);
+    plan.row_first.SetCount(nrows);
+    plan.row_top.SetCount(nrows);
+    plan.row_h.SetCount(nrows);
+    plan.row_w.SetCount(nrows);
+
+    int y = keep > 0 ? plan.row_top[keep - 1] + plan.row_h[keep - 1] + gap : irc.top;
+    for(int r = keep; r < nrows; ++r) {
+        const int s = starts[nrows - 1 - r];
+        const int e = r + 1 < nrows ? starts[nrows - 2 - r] : m;
+        row[r] = s;
+
+        // height: fills the width, unless a short last row of its section
+        const bool last = e == m || sect[e] == e;
+        double h = height(s, e);
+        const bool fill = !(last && h > target);
+        if(!fill) h = target;
+        const int row_h = max(0, (int)(h + 0.5));
+        const int span  = inner_w - (e - s - 1) * gap;
+
+        const int lo = r > 0 ? item[s] : 0;
+        const int hi = r + 1 < nrows ? item[e] : n;
+        for(int i = lo; i < hi; ++i) {
+            FlowCell& cl = plan.cells[i];
+            if(cl.visible) cl.rowOrCol = r;
+        }
+        int x = irc.left, end = 0;
+        for(int k = s; k < e; ++k) {
+            const int next = fill && k + 1 == e ? span : max(end, (int)((P[k + 1] - P[s]) * h + 0.5));
+            FlowCell& cl = plan.cells[item[k]];
+            cl.cell    = Rect(x, y, x + next - end, y + row_h);
+            cl.content = cl.cell;
+            cl.placed  = true;
+            x += next - end + gap;
+            end = next;
+        }
+        plan.row_first[r] = lo;
+        plan.row_top[r]   = y;
+        plan.row_h[r]     = row_h;
+        plan.row_w[r]     = x - gap - irc.left;
+        y += row_h + gap;
+    }
+
+    plan.used_w = 0;
+    for(int w : plan.row_w)
+        plan.used_w = max(plan.used_w, w);
+    plan.used_h = nrows ? y - gap - irc.top : 0;
+}
+
+// -----------------------------------------------------------------------------
+// Hit index
+//
+// The placed content items of the committed plan grouped into bands: the
+// rows of an H plan, the columns of a masonry or of V + wrap, the whole
+// stack of a V plan. Bands do not overlap and follow each other across
+// (down for rows, right for columns); inside a band the cells follow each
+// other along it. Per band its extent across, per item the start of its
+// cell along the band, so a point or a rect is found by a binary search
+// over the bands and one inside each band it meets. Built on first use
+// after a change, O(n).
+// -----------------------------------------------------------------------------
+// First k in [lo, hi) with v[k] > val (hi if none)
+static int UpperBound(const Vector<int>& v, int lo, int hi, int val) {
+    while(lo < hi) {
+        const int m = (lo + hi) / 2;
+        if(v[m] <= val) lo = m + 1;
+        else hi = m;
+    }
+    return lo;
+}
+
+void FlowLayoutSolver::BuildHits() const {
+    HitIndex& x = hits;
+    x.columns = plan.mas_cols > 0 || plan.cfg.dir == V;
+    x.band_at.Trim(0);
+    x.band_lo.Trim(0);
+    x.band_hi.Trim(0);
+    x.items.Trim(0);
+    x.at.Trim(0);
+    x.valid = true;
+    if(plan.cells.GetCount() != GetCount()) return;
+
+    bool open = false;                 // the next item joins the last band
+    auto add = [&](int i) {
+        const FlowCell& cl = plan.cells[i];
+        if(!cl.visible || !cl.placed || !IsContent(i)) return;
+        const Rect& r = cl.cell;
+        const int lo = x.columns ? r.left : r.top;
+        const int hi = x.columns ? r.right : r.bottom;
+        if(!open) {
+            x.band_at.Add(x.items.GetCount());
+            x.band_lo.Add(lo);
+            x.band_hi.Add(hi);
+            open = true;
+        }
+        x.band_lo.Top() = min(x.band_lo.Top(), lo);
+        x.band_hi.Top() = max(x.band_hi.Top(), hi);
+        x.items.Add(i);
+        x.at.Add(x.columns ? r.top : r.left);
+    };
+
+    if(plan.mas_cols > 0)
+        for(const Vector<int>& col : plan.col_items) {
+            for(int i : col)
+                add(i);
+            open = false;
+        }
+    else {
+        // rows (H) and columns (V + wrap) are runs of rowOrCol; a stack is one
+        const bool runs = plan.cfg.dir == H || plan.cfg.wrap;
+        for(int i = 0; i < GetCount(); ++i) {
+            if(runs && open && plan.cells[i].rowOrCol != plan.cells[x.items.Top()].rowOrCol &&
+               plan.cells[i].placed)
+                open = false;
+            add(i);
+        }
+    }
+    x.band_at.Add(x.items.GetCount());
+}
+
+void FlowLayoutSolver::ItemsIn(const Rect& r, Vector<int>& items) const {
+    items.Trim(0);
+    if(r.IsEmpty()) return;            // intersects nothing, like Rect::Intersects
+    if(!hits.valid) BuildHits();
+    const HitIndex& x = hits;
+    const int lo = x.columns ? r.left : r.top,  hi = x.columns ? r.right : r.bottom;
+    const int a0 = x.columns ? r.top  : r.left, a1 = x.columns ? r.bottom : r.right;
+
+    // first band ending past lo, then each band starting before hi
+    for(int b = UpperBound(x.band_hi, 0, x.band_hi.GetCount(), lo);
+        b < x.band_lo.GetCount() && x.band_lo[b] < hi; ++b) {
+        const int e = x.band_at[b + 1];
+        // from the last cell starting at or before a0 (it may reach into it)
+        int k = max(x.band_at[b], UpperBound(x.at, x.band_at[b], e, a0) - 1);
+        for(; k < e && x.at[k] < a1; ++k) {
+            const int i = x.items[k];
+            if(plan.cells[i].cell.Intersects(r))
+                items.Add(i);
+        }
+    }
+    if(x.columns)
+        Sort(items);
+}
+
+int FlowLayoutSolver::ItemAt(Point p) const {
+    if(!hits.valid) BuildHits();
+    const HitIndex& x = hits;
+    const int across = x.columns ? p.x : p.y, along = x.columns ? p.y : p.x;
+
+    // the band whose extent holds p, then the last cell starting at or before it
+    const int b = UpperBound(x.band_hi, 0, x.band_hi.GetCount(), across);
+    if(b >= x.band_lo.GetCount() || x.band_lo[b] > across)
+        return -1;
+    const int k = UpperBound(x.at, x.band_at[b], x.band_at[b + 1], along) - 1;
+    if(k < x.band_at[b])
+        return -1;
+    const int i = x.items[k];
+    return plan.cells[i].cell.Contains(p) ? i : -1;
+}
+
+void FlowLayoutSolver::GetItemsInRange(int top, int bottom, Vector<int>& items) const {
+    ItemsIn(Rect(INT_MIN, top, INT_MAX, bottom), items);
+}
+
+// -----------------------------------------------------------------------------
+// Expand distribution
+//
+// Expanding items are packed into the exp_* scratch arrays (size, weight,
+// caps) and resolved the way flexbox resolves flexible lengths: all grow at
+// one rate per unit of weight until an item reaches its max cap; it is
+// frozen there and the space it cannot take goes to the others, which then
+// grow faster. Item k saturates at rate (hi[k] - size[k]) / weight[k], and
+// freezing an item never lowers the rate of the rest, so visiting items by
+// saturation rate and stopping at the first that does not saturate finds
+// the frozen set in one sorted pass, however many items clamp.
+//
+// The unfrozen items then get floor(free * weight / weight_left) each,
+// which also takes every frozen item to its cap; the pixels lost to
+// rounding (fewer than there are unfrozen items, each with room for one)
+// go one each, in order. Min caps take no part: sizes start within them
+// and only grow.
+//
+// That last step is independent per item; ExpandShares computes it four at
+// a time, in double: with weights below 2^22 products stay below 2^53,
+// where the truncated quotient is exact.
+// -----------------------------------------------------------------------------
+namespace {
+
+#if defined(FLOW_AVX2) || defined(FLOW_SSE2)
+#ifdef FLOW_AVX2
+inline __m128i Max32(__m128i a, __m128i b) { return _mm_max_epi32(a, b); }
+inline __m128i Min32(__m128i a, __m128i b) { return _mm_min_epi32(a, b); }
+#else
+inline __m128i Max32(__m128i a, __m128i b) {
+    const __m128i m = _mm_cmpgt_epi32(b, a);
+    return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+}
+inline __m128i Min32(__m128i a, __m128i b) {
+    const __m128i m = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a));
+}
+#endif
+
+// Shares of four weights
+inline __m128i Shares4(__m128i w, double remainder, double total) {
+#ifdef FLOW_AVX2
+    const __m256d q = _mm256_div_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(w), _mm256_set1_pd(remainder)),
+                                    _mm256_set1_pd(total));
+    return _mm256_cvttpd_epi32(q);
+#else
+    const __m128d r = _mm_set1_pd(remainder), t = _mm_set1_pd(total);
+    const __m128i lo = _mm_cvttpd_epi32(_mm_div_pd(_mm_mul_pd(_mm_cvtepi32_pd(w), r), t));
+    const __m128i hi = _mm_cvttpd_epi32(_mm_div_pd(_mm_mul_pd(
+                           _mm_cvtepi32_pd(_mm_shuffle_epi32(w, _MM_SHUFFLE(1, 0, 3, 2))), r), t));
+    return _mm_unpacklo_epi64(lo, hi);
+#endif
+}
+#endif
+
+// Grows size[k] by remainder * weight[k] / total, clamped to [lo[k], hi[k]];
+// returns the sum of the growths. vec: the shares are known to stay below
+// 2^20 and total below 2^22.
+int ExpandShares(int* size, const int* weight, const int* lo, const int* hi,
+                 int n, int remainder, int total, bool vec) {
+    int k = 0;
+    int64 consumed = 0;
+#if defined(FLOW_AVX2) || defined(FLOW_SSE2)
+    if(vec) {
+        __m128i acc = _mm_setzero_si128();
+        for(; k + 4 <= n; k += 4) {
+            const __m128i s0 = _mm_loadu_si128((const __m128i*)(size + k));
+            __m128i v = _mm_add_epi32(s0, Shares4(_mm_loadu_si128((const __m128i*)(weight + k)),
+                                                  remainder, total));
+            v = Max32(v, _mm_loadu_si128((const __m128i*)(lo + k)));
+            v = Min32(v, _mm_loadu_si128((const __m128i*)(hi + k)));
+            _mm_storeu_si128((__m128i*)(size + k), v);
+            acc = _mm_add_epi32(acc, _mm_sub_epi32(v, s0));
+        }
+        int lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        consumed = (int64)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for(; k < n; ++k) {
+        const int64 g = size[k] + (int64)remainder * weight[k] / total;
+        const int v = (int)min(max(g, (int64)lo[k]), (int64)hi[k]);
+        consumed += v - size[k];
+        size[k] = v;
+    }
+    return (int)consumed;
+}
+
+int Resolve(int* size, const int* weight, const int* lo, const int* hi,
+            int n, int remainder, Vector<int>& order, bool vec) {
+    int64 total = 0;
+    int wmax = 0;
+    for(int k = 0; k < n; ++k) {
+        total += weight[k];
+        wmax = max(wmax, weight[k]);
+    }
+    if(remainder <= 0 || total <= 0)
+        return 0;
+
+    // freeze the items that saturate, lowest rate first
+    int64 free = remainder, left = total;
+    auto saturates = [&](int k) {
+        return (int64)(hi[k] - size[k]) * left <= free * weight[k];
+    };
+    bool clamps = false;
+    for(int k = 0; k < n && !clamps; ++k)
+        clamps = saturates(k);
+    if(clamps) {
+        order.Trim(0);
+        for(int k = 0; k < n; ++k)
+            if(hi[k] < INT_MAX)
+                order.Add(k);
+        Sort(order, [&](int a, int b) {
+            return (int64)(hi[a] - size[a]) * weight[b] < (int64)(hi[b] - size[b]) * weight[a];
+        });
+        for(int k : order) {
+            if(!saturates(k)) break;
+            free -= hi[k] - size[k];
+            left -= weight[k];
+        }
+    }
+
+    if(left == 0) {                            // everything is at its cap
+        int used = 0;
+        for(int k = 0; k < n; ++k) {
+            used += hi[k] - size[k];
+            size[k] = hi[k];
+        }
+        return used;
+    }
+
+    vec = vec && total < (1 << 22) && free * wmax < (left << 20);
+    int used = ExpandShares(size, weight, lo, hi, n, (int)free, (int)left, vec);
+
+    // rounding leftovers
+    for(int k = 0; k < n && used < remainder; ++k)
+        if(size[k] < hi[k]) {
+            ++size[k];
+            ++used;
+        }
+    return used;
+}
+
+}
+
+void FlowLayoutSolver::ClearExpand() {
+    scratch.exp_size.Trim(0);
+    scratch.exp_weight.Trim(0);
+    scratch.exp_min.Trim(0);
+    scratch.exp_max.Trim(0);
+}
+
+void FlowLayoutSolver::AddExpand(int size, int weight, int minv, int maxv) {
+    // ClampWith semantics: unset (negative) caps do not apply
+    scratch.exp_size.Add(size);
+    scratch.exp_weight.Add(weight);
+    scratch.exp_min.Add(minv < 0 ? INT_MIN : minv);
+    scratch.exp_max.Add(maxv < 0 ? INT_MAX : maxv);
+}
+
+int FlowLayoutSolver::DistributeExpand(int remainder) {
+    Scratch& s = scratch;
+    return Resolve(s.exp_size.begin(), s.exp_weight.begin(), s.exp_min.begin(),
+                   s.exp_max.begin(), s.exp_size.GetCount(), remainder, s.exp_order, simd);
+}
+
+int FlowLayoutSolver::Distribute(int* size, const int* weight, const int* lo, const int* hi,
+                                 int n, int remainder, bool simd) {
+    Vector<int> order;
+    return Resolve(size, weight, lo, hi, n, remainder, order, simd);
+}
+
+int FlowLayoutSolver::StackCellHeight(int i, int inner_w, int& wshare) {
+    const Caps& cp = CapsOf(i);
+    const int fixed_row = plan.cfg.fixed_row;
+
+    wshare = 0;
+    if(fixed_row >= 0)
+        return fixed_row;
+
+    int h = 0;
+    if(Kind(i) == FlowItemSpec::BREAK) {
+        h = max(plan.cfg.gap, 0);
+        if(item_weight[i] <= 0) wshare = 1; // gap-expander
+    }
+    else if(Kind(i) == FlowItemSpec::SPACER) {
+        h = 0;
+        wshare = max(1, item_weight[i]);
+    }
+    else {
+        const Size ms = item_min[i];
+        if(item_fixed[i] >= 0)        h = item_fixed[i];
+        else if(Fit(i)) {
+            h = ms.cy;
+
+            // height-for-width (e.g. an H child that wraps & auto-resizes)
+            if(IsHfw(i) && WhenHeightForWidth)
+                h = max(h, WhenHeightForWidth(i, inner_w));
+        }
+        else if(item_weight[i] > 0)   h = 0;
+        else                          h = ms.cy;
+        if(item_weight[i] > 0)        wshare = max(1, item_weight[i]);
+    }
+    return ClampWith(cp.minh, cp.maxh, h);
+}
+
+int FlowLayoutSolver::PlaceStackCell(int i, const Rect& irc, int inner_w, int y, int h, int k) {
+    const Caps& cp = CapsOf(i);
+    FlowCell& cl = plan.cells[i];
+
+    cl.cell = Rect(irc.left, y, irc.right, y + h);
+    cl.rowOrCol = k;
+    cl.placed = true;
+
+    if(!IsContent(i)) {
+        cl.content = Rect(0,0,0,0);
+        return 0;
+    }
+
+    const Size ms = item_min[i];
+    Align ha = EffAlign(i);
+    int natural_w = (item_fixed[i] >= 0 ? item_fixed[i] : ms.cx);
+    natural_w = ClampWith(cp.minw, cp.maxw, natural_w);
+
+    int cw = (ha == Align::Stretch || ha == Align::Auto)
+               ? ClampWith(cp.minw, cp.maxw, inner_w)
+               : min(natural_w, inner_w);
+    int cx = irc.left;
+    if(ha == Align::Center && cw < inner_w) cx = irc.left + (inner_w - cw) / 2;
+    else if(ha == Align::End && cw < inner_w) cx = irc.right - cw;
+
+    cl.content = Rect(cx, y, cx + cw, y + h);
+    return cw;
+}
+
+void FlowLayoutSolver::LayoutVertical(const Rect& irc, int inner_w, int inner_h) {
+    const int gap       = plan.cfg.gap;
+    const int fixed_row = plan.cfg.fixed_row;
+
+    Vector<VCell>& stack = scratch.stack;
+    stack.Trim(0);
+
+    int base_sum_h = 0;
+    int exp_weight_sum = 0;
+
+    // build cells
+    for(int i = 0; i < GetCount(); ++i) {
+        if(!plan.cells[i].visible) continue;
+
+        VCell c; c.idx = i;
+        c.h = StackCellHeight(i, inner_w, c.wshare);
+
+        base_sum_h += c.h;
+        exp_weight_sum += c.wshare;
+        stack.Add(c);
+    }
+
+    // distribute remainder
+    const int gaps_total = max(0, stack.GetCount() - 1) * gap;
+    int remainder = (fixed_row >= 0 ? 0 : max(0, inner_h - (base_sum_h + gaps_total)));
+
+    if(fixed_row < 0 && exp_weight_sum > 0 && remainder > 0) {
+        Vector<int>& exp_idx = scratch.exp_idx;
+        exp_idx.Trim(0);
+        ClearExpand();
+        for(int k = 0; k < stack.GetCount(); ++k) {
+            if(stack[k].wshare <= 0) continue;
+            const Caps& cp = CapsOf(stack[k].idx);
+            exp_idx.Add(k);
+            AddExpand(stack[k].h, stack[k].wshare, cp.minh, cp.maxh);
+        }
+        DistributeExpand(remainder);
+        for(int k = 0; k < exp_idx.GetCount(); ++k)
+            stack[exp_idx[k]].h = scratch.exp_size[k];
+    }
+
+    // place top→bottom
+    int y = irc.top;
+    int max_w = 0;
+
+    for(int k = 0; k < stack.GetCount(); ++k) {
+        max_w = max(max_w, PlaceStackCell(stack[k].idx, irc, inner_w, y, stack[k].h, k));
+
+        y += stack[k].h;
+        if(k + 1 < stack.GetCount()) y += gap;
+    }
+
+    plan.used_w = max_w;
+    plan.used_h = min(inner_h, y - irc.top);
+
+    plan.v_flex   = (fixed_row < 0 && exp_weight_sum > 0);
+    plan.v_bottom = y;
+}
+
+bool FlowLayoutSolver::ResumeVertical(const Rect& irc, int inner_w, int inner_h) {
+    // expanders share the remainder: any change can move every cell
+    // (columns always set v_flex)
+    if(plan.v_flex) return false;
+
+    const int gap = plan.cfg.gap;
+    const int n   = GetCount();
+    const int lo  = min(plan.dirty_lo, n);
+    const int hi  = min(plan.dirty_hi, n - 1);
+
+    // first changed cell starts below the last visible cell above it
+    int y = irc.top, k = 0;
+    for(int i = lo - 1; i >= 0; --i)
+        if(plan.cells[i].visible) {
+            y = plan.cells[i].cell.bottom + gap;
+            k = plan.cells[i].rowOrCol + 1;
+            break;
+        }
+
+    bool rescan_w = plan.used_w < 0;   // see Remove
+    for(int i = lo; i <= hi; ++i) {
+        // the widest cell may shrink (or stop being content: judge by the
+        // old cell, the spec may already say spacer)
+        const FlowCell& cl = plan.cells[i];
+        if(cl.visible && !cl.content.IsEmpty() && cl.content.GetWidth() >= plan.used_w)
+            rescan_w = true;
+        if(!MarkItem(i)) {
+            plan.grid_cols = 0;        // slots no longer follow indices
+            continue;
+        }
+
+        int wshare;
+        const int h = StackCellHeight(i, inner_w, wshare);
+        if(wshare > 0) return false;   // a new expander: remainder to share
+
+        plan.used_w = max(plan.used_w, PlaceStackCell(i, irc, inner_w, y, h, k++));
+        y += h + gap;
+    }
+    if(k == 0) return false;           // nothing visible: let the full pass decide
+
+    // the rest keeps its cells, moved by the height delta
+    int tail = hi + 1;
+    while(tail < n && !plan.cells[tail].visible) ++tail;
+    if(tail < n) {
+        const int dy = y - plan.cells[tail].cell.top;
+        const int dk = k - plan.cells[tail].rowOrCol;
+        if(dy || dk)
+            for(int i = tail; i < n; ++i) {
+                FlowCell& cl = plan.cells[i];
+                if(!cl.visible) continue;
+                cl.rowOrCol += dk;
+                cl.cell.Offset(0, dy);
+                if(IsContent(i)) cl.content.Offset(0, dy);
+            }
+        plan.v_bottom += dy;
+    }
+    else
+        plan.v_bottom = y - gap;
+
+    if(rescan_w) {
+        plan.used_w = 0;
+        for(int i = 0; i < n; ++i)
+            if(plan.cells[i].visible && IsContent(i))
+                plan.used_w = max(plan.used_w, plan.cells[i].content.GetWidth());
+    }
+    plan.used_h = min(inner_h, plan.v_bottom - irc.top);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Column wrap (V + wrap)
+//
+// Items stack top to bottom and move on to a new column, right of the
+// previous one, when they would end below the inner height; a break starts
+// a new column. A column is fixed_column wide if set, else as wide as its
+// widest item. Nothing depends on the inner width, so the used width is a
+// width-for-height answer and a plan measured at any width is adopted at
+// the real one (width_free). Expanders and spacers share the height left
+// in their own column. Height-for-width items are asked at the column
+// width when fixed, else at their own.
+// -----------------------------------------------------------------------------
+int FlowLayoutSolver::ColumnItemWidth(int i) const {
+    const Caps& cp = CapsOf(i);
+    return ClampWith(cp.minw, cp.maxw, item_fixed[i] >= 0 ? item_fixed[i] : item_min[i].cx);
+}
+
+void FlowLayoutSolver::LayoutColumns(const Rect& irc, int inner_h) {
+    const int gap          = plan.cfg.gap;
+    const int fixed_column = plan.cfg.fixed_column;
+    const int fixed_row    = plan.cfg.fixed_row;
+    const bool measuring   = inner_h > 100000000;
+
+    // stack entries top to bottom; column c owns [col_at[c], col_at[c + 1])
+    Vector<VCell>& stack  = scratch.stack;
+    Vector<int>&   col_at = scratch.cell_at;
+    stack.Trim(0);
+    col_at.Trim(0);
+    col_at.Add(0);
+
+    // a column moves on once it holds an item (spacers alone go along)
+    int col_h = 0;
+    bool filled = false;
+    for(int i = 0; i < GetCount(); ++i) {
+        FlowCell& cl = plan.cells[i];
+        if(!cl.visible) continue;
+
+        if(Kind(i) == FlowItemSpec::BREAK) {
+            cl.breakMark = true;
+            cl.rowOrCol  = col_at.GetCount() - 1;
+            if(stack.GetCount() > col_at.Top()) {
+                col_at.Add(stack.GetCount());
+                col_h = 0;
+                filled = false;
+            }
+            continue;
+        }
+
+        VCell c; c.idx = i;
+        const int at_w = fixed_column >= 0 ? fixed_column : ColumnItemWidth(i);
+        c.h = StackCellHeight(i, at_w, c.wshare);
+
+        if(filled && IsContent(i) && col_h + gap + c.h > inner_h) {
+            col_at.Add(stack.GetCount());
+            col_h = 0;
+            filled = false;
+        }
+        col_h += (stack.GetCount() > col_at.Top() ? gap : 0) + c.h;
+        filled = filled || IsContent(i);
+        stack.Add(c);
+    }
+    if(stack.GetCount() > col_at.Top() || col_at.GetCount() == 1)
+        col_at.Add(stack.GetCount());
+
+    // place column by column
+    const int ncols = col_at.GetCount() - 1;
+    int x = irc.left, bottom = irc.top;
+    for(int c = 0; c < ncols; ++c) {
+        const int a = col_at[c], b = col_at[c + 1];
+
+        int col_w = fixed_column;
+        if(col_w < 0) {
+            col_w = 0;
+            for(int k = a; k < b; ++k)
+                if(IsContent(stack[k].idx))
+                    col_w = max(col_w, ColumnItemWidth(stack[k].idx));
+        }
+
+        // expanders share what the column leaves of the height
+        int used = max(0, b - a - 1) * gap, weights = 0;
+        for(int k = a; k < b; ++k) {
+            used += stack[k].h;
+            weights += stack[k].wshare;
+        }
+        const int remainder = inner_h - used;
+        if(fixed_row < 0 && weights > 0 && remainder > 0 && !measuring) {
+            Vector<int>& exp_idx = scratch.exp_idx;
+            exp_idx.Trim(0);
+            ClearExpand();
+            for(int k = a; k < b; ++k) {
+                if(stack[k].wshare <= 0) continue;
+                const Caps& cp = CapsOf(stack[k].idx);
+                exp_idx.Add(k);
+                AddExpand(stack[k].h, stack[k].wshare, cp.minh, cp.maxh);
+            }
+            DistributeExpand(remainder);
+            for(int k = 0; k < exp_idx.GetCount(); ++k)
+                stack[exp_idx[k]].h = scratch.exp_size[k];
+        }
+
+        const Rect col(x, irc.top, x + col_w, irc.bottom);
+        int y = irc.top;
+        for(int k = a; k < b; ++k) {
+            PlaceStackCell(stack[k].idx, col, col_w, y, stack[k].h, c);
+            y += stack[k].h + (k + 1 < b ? gap : 0);
+        }
+        bottom = max(bottom, y);
+        x += col_w + (c + 1 < ncols ? gap : 0);
+    }
+
+    plan.used_w = x - irc.left;
+    plan.used_h = min(inner_h, bottom - irc.top);
+    plan.v_flex   = true;
+    plan.v_bottom = bottom;
+}
+
+} // namespace Upp
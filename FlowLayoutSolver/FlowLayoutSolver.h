@@ -0,0 +1,547 @@
+#ifndef _FlowLayoutSolver_FlowLayoutSolver_h_
+#define _FlowLayoutSolver_FlowLayoutSolver_h_
+
+// -----------------------------------------------------------------------------
+// FlowLayoutSolver
+//
+// The layout engine behind FlowBoxLayout, as plain data: an array of item
+// specs plus a container configuration in, cell/content rects out. It only
+// depends on Core (no Ctrl, no GUI), so layouts can be computed, benchmarked
+// and tested in console processes or precomputed on worker threads.
+// FlowBoxLayout is a thin adapter that feeds it child min sizes and commits
+// the resulting rects.
+//
+// Typical usage
+// =============
+//     FlowLayoutSolver s;
+//     FlowLayoutConfig cfg;
+//     cfg.dir = FlowLayoutSolver::H; cfg.wrap = true; cfg.gap = 8;
+//     for(Size sz : tiles) {
+//         FlowItemSpec it;
+//         it.fit = true;
+//         it.min_size = sz;
+//         s.Add(it);
+//     }
+//     s.Solve(cfg, RectC(0, 0, 800, 600));
+//     Rect r = s.GetCell(3).content;
+//
+// Change tracking
+// ===============
+// Add/SetCount track structural changes and SetSpec/SetVisible/SetMinSize
+// the changed items, so the next Solve can resume from the first affected
+// row; InvalidateAll() forces a full replan. A configuration or size change
+// always replans fully.
+//
+// Storage
+// =======
+// Specs are not kept as FlowItemSpec records but split by use: the fields
+// every pass reads (flags, fixed size, weight, min size) live in packed
+// parallel arrays, the rarely set caps in a side table that only items
+// with non-default caps have an entry in.
+// -----------------------------------------------------------------------------
+
+#include <Core/Core.h>
+#include <limits.h>
+
+namespace Upp {
+
+// Enums shared by the solver and FlowBoxLayout.
+struct FlowLayoutTypes {
+    // Primary direction of the flow. H wraps into rows, V into columns.
+    enum Direction { H, V };
+
+    // Cross-axis alignment (secondary axis), both as a container default
+    // and per-item override.
+    enum Align     { Auto,        // use container default (do not override)
+                     Stretch,     // fill cross-axis
+                     Start,       // align to start (top for H, left for V)
+                     Center,      // center on the cross-axis
+                     End };       // align to end (bottom for H, right for V)
+};
+
+// Sizing spec of one item (main axis = width in H, height in V). The solver
+// stores it split into arrays (see Storage above); this is the value type
+// used to read and write it.
+struct FlowItemSpec : Moveable<FlowItemSpec> {
+    enum Kind { CONTENT,          // a child (or a virtual tile)
+                SPACER,           // AddSpacer semantics
+                BREAK };          // AddBreak semantics
+
+    byte   kind            = CONTENT;
+    bool   visible         = true;        // CONTENT only: participates this pass
+    bool   fit             = false;       // true => Fit() on main axis
+    bool   hfw             = false;       // size depends on the other axis (see When*For*)
+    int    fixed           = -1;          // >=0 => Fixed(px) on main axis
+    int    expandingWeight = 0;           // >0  => Expand(weight)
+    int    minw            = -1;          // main-axis MIN cap  (if set >=0)
+    int    maxw            = 2048;        // main-axis MAX cap  (if set >=0)
+    int    minh            = -1;          // cross-axis MIN cap (if set >=0)
+    int    maxh            = INT_MAX;     // cross-axis MAX cap (if set >=0)
+    FlowLayoutTypes::Align align_self = FlowLayoutTypes::Auto;
+    Size   min_size        = Size(0,0);   // intrinsic (minimum) size of the content
+};
+
+// Result of one item after Solve.
+struct FlowCell : Moveable<FlowCell> {
+    bool visible   = false;  // participates in this pass
+    bool spacer    = false;  // explicit spacer (AddSpacer)
+    bool breakMark = false;  // explicit hard wrap (AddBreak)
+    bool placed    = false;  // cell/content were written this pass
+    int  rowOrCol  = -1;     // row index (H), position (V) or column (V + wrap)
+    Rect cell;               // cell rect (before cross-axis align)
+    Rect content;            // final rect of the content
+};
+
+// Container-wide configuration (see the FlowBoxLayout setters).
+struct FlowLayoutConfig {
+    FlowLayoutTypes::Direction dir         = FlowLayoutTypes::V;
+    FlowLayoutTypes::Align     align_items = FlowLayoutTypes::Stretch;
+    int   gap              = 0;
+    bool  wrap             = false;  // H: rows, V: columns
+    bool  wrap_rows_expand = false;
+    int   fixed_column     = -1;   // H: cap width of all non-break items; V + wrap: column width
+    int   fixed_row        = -1;   // V: cap height of all non-break items
+    bool  masonry          = false; // H + wrap + fixed_column: shortest column first
+    int   justify_row      = -1;   // H + wrap: target height of justified rows
+    bool  wrap_balance     = false; // H + wrap: even out the rows of each section
+    int   wrap_balance_max = 1000;  // ... of at most this many items (else greedy)
+
+    bool operator==(const FlowLayoutConfig& b) const {
+        return dir == b.dir && align_items == b.align_items && gap == b.gap &&
+               wrap == b.wrap && wrap_rows_expand == b.wrap_rows_expand &&
+               fixed_column == b.fixed_column && fixed_row == b.fixed_row &&
+               masonry == b.masonry && justify_row == b.justify_row &&
+               wrap_balance == b.wrap_balance && wrap_balance_max == b.wrap_balance_max;
+    }
+    bool operator!=(const FlowLayoutConfig& b) const { return !(*this == b); }
+};
+
+class FlowLayoutSolver : public FlowLayoutTypes {
+public:
+    // -------------------------------------------------------------------------
+    // Items
+    // -------------------------------------------------------------------------
+    int                 Add(const FlowItemSpec& s = FlowItemSpec()); // append, returns index
+    void                SetCount(int n);           // grow/trim (tracked)
+
+    // Structural edits (tracked): later items move up or down, and so do
+    // their cells in the plan, so the next Solve resumes at the row of the
+    // first index touched and keeps the rows past it that start with the
+    // same item as before (H) or moves the cells below it (V).
+    void                Insert(int i, const FlowItemSpec& s, int count = 1);
+    void                Remove(int i, int count = 1);
+    void                Move(int from, int to);    // item 'from' ends up at index 'to'
+    void                Clear();
+    int                 GetCount() const           { return item_min.GetCount(); }
+
+    FlowItemSpec        GetSpec(int i) const;
+    void                SetSpec(int i, const FlowItemSpec& s);   // tracked if changed
+
+    // The fields an adapter syncs every pass, without a whole spec
+    bool                IsVisible(int i) const     { return item_flags[i] & F_VISIBLE; }
+    Size                GetMinSize(int i) const    { return item_min[i]; }
+    void                SetVisible(int i, bool v);               // tracked if changed
+    void                SetMinSize(int i, Size sz);              // tracked if changed
+    bool                IsContent(int i) const     { return Kind(i) == FlowItemSpec::CONTENT; }
+    bool                IsHfw(int i) const         { return item_flags[i] & F_HFW; }
+
+    // -------------------------------------------------------------------------
+    // Change tracking
+    // -------------------------------------------------------------------------
+    void Invalidate(int i)  { plan.Invalidate(i); probe.Invalidate(i); ++rev; hits.valid = false; }
+    void InvalidateAll()    { plan.dirty_all = probe.dirty_all = true; ++rev; hits.valid = false; }
+
+    // True if Solve(cfg, inner of this size) can keep part of the current
+    // plan; the items it will re-read are then [GetDirtyLo(), GetDirtyHi()].
+    bool CanResume(const FlowLayoutConfig& cfg, Size inner) const;
+    int  GetDirtyLo() const { return plan.dirty_lo; }
+    int  GetDirtyHi() const { return plan.dirty_hi; }
+
+    // Width-dependent items (spec.hfw). Called while planning Fit() items;
+    // return the natural size of item i for the given extent, or 0 if none.
+    Function<int (int i, int width)>  WhenHeightForWidth;  // V, masonry: height at width
+    Function<int (int i, int height)> WhenWidthForHeight;  // H: width at height
+
+    // -------------------------------------------------------------------------
+    // Solve / results
+    // -------------------------------------------------------------------------
+
+    // Plan all items into the inner rect (content box of the container).
+    // Huge inner heights (> 100000000) are treated as measuring probes.
+    void Solve(const FlowLayoutConfig& cfg, const Rect& inner);
+
+    // Used size of a plan into the given inner rect, computed in a separate
+    // probe plan: the committed plan and its results are left untouched. A
+    // following Solve at the same width adopts the probe instead of planning
+    // again when its rows did not depend on the height (H + wrap, no growing
+    // rows, no width-for-height items); likewise at the same height for
+    // columns (V + wrap), which never depend on the width.
+    Size Measure(const FlowLayoutConfig& cfg, const Rect& inner);
+
+    const FlowCell& GetCell(int i) const   { return plan.cells[i]; }
+    int   GetUsedWidth()  const            { return plan.used_w; }
+    int   GetUsedHeight() const            { return plan.used_h; }
+    Size  GetPlanSize() const              { return plan.inner; }
+    int   GetRowCount() const              { return plan.row_first.GetCount(); }
+
+    // Columns (cfg.wrap with V): items stack down and continue in a new
+    // column to the right when the next one would end below the inner
+    // height, or after a break. Columns are fixed_column wide if set, else
+    // as wide as their widest item, and expanders share what is left of
+    // their column's height. The used width is then the width the items
+    // need at that height, whatever the inner width (FlowCell::rowOrCol is
+    // the column).
+
+    // Inner widths at which H + wrap builds the same rows as the current
+    // plan (empty, min > max, if none is known). Solve and Measure answer a
+    // resize within them without rebuilding rows: rows that have expanders
+    // or spacers get their remainder again, the others are kept as they
+    // are (see Reflow in the .cpp).
+    int   GetRowsMinWidth() const          { return plan.rows_lo; }
+    int   GetRowsMaxWidth() const          { return plan.rows_hi; }
+
+    // Uniform grid: every cell has the same size and item i sits in slot i
+    // (H + wrap with fixed column and fixed row, or V with fixed row, all
+    // items visible and no spacers/breaks in H). Such plans are computed in
+    // closed form, and GetGridRect answers “cell of item i” without the plan,
+    // e.g. to scroll to an item.
+    bool  IsGrid() const                   { return plan.grid_cols > 0; }
+    int   GetGridColumns() const           { return plan.grid_cols; }
+    Rect  GetGridRect(int i) const {
+        const int cols = plan.grid_cols;
+        const Size cell = plan.grid_cell;
+        const int  x = plan.origin.x + i % cols * (cell.cx + plan.cfg.gap);
+        const int  y = plan.origin.y + i / cols * (cell.cy + plan.cfg.gap);
+        return Rect(x, y, x + cell.cx, y + cell.cy);
+    }
+
+    // Masonry (cfg.masonry with H + wrap + fixed_column): columns of the
+    // fixed width, each item going to the one that currently ends highest
+    // (leftmost on ties), picked from a min-heap of column bottoms, so a
+    // plan is O(n log columns) and appending items O(columns) plus their
+    // own. Item heights are their min heights (height-for-width items at
+    // the column width), fixed_row if set; a break levels all columns to
+    // the longest one, spacers take no room. Columns are the same at any
+    // width of GetRowsMinWidth()..GetRowsMaxWidth().
+    bool  IsMasonry() const                { return plan.mas_cols > 0; }
+    int   GetMasonryColumns() const        { return plan.mas_cols; }
+
+    // Balanced wrap (cfg.wrap_balance with H + wrap): each section (the rows
+    // between two breaks) keeps the number of rows greedy filling gives it,
+    // but the breaks are moved so the rows fill evenly, like CSS
+    // text-wrap: balance (a 7-item toolbar wraps as 4 + 3, not 6 + 1). They
+    // minimize the sum of squared free space per row, last row included,
+    // by dynamic programming over the break points; sections of more than
+    // cfg.wrap_balance_max items stay greedy.
+
+    // Justified rows (cfg.justify_row > 0 with H + wrap, no masonry):
+    // photo galleries. Every visible content item keeps the aspect ratio of
+    // its min size and each row is scaled to fill the width exactly; the
+    // breaks are the ones that minimize the sum of (row height - target)^2
+    // over all rows, found by dynamic programming. A row is never squeezed
+    // below half the target height, which bounds how far back a row can
+    // start, so planning is linear in the item count. The last row and rows
+    // before a break are not stretched past the target. Appending items
+    // extends the program and re-places only the rows that changed at the
+    // end. Caps, sizing modes and alignment do not apply.
+    bool  IsJustified() const              { return plan.jr_count > 0; }
+
+    // Hit testing on the committed plan, through an index of its rows
+    // (columns for masonry and V) built on first use after a change: a
+    // binary search for the row, then one for the cell in it, O(log n).
+    // ItemAt is the content item whose cell contains p, -1 if none;
+    // ItemsIn the content items whose cells intersect r, in index order
+    // (rubber-band selection, drop targets); GetItemRect the cell of item
+    // i (Null if not placed).
+    int   ItemAt(Point p) const;
+    void  ItemsIn(const Rect& r, Vector<int>& items) const;
+    Rect  GetItemRect(int i) const         { return plan.cells[i].placed ? plan.cells[i].cell : Rect(Null); }
+
+    // Content items whose cells intersect the band [top, bottom) of the
+    // committed plan, in index order (e.g. those to realize while
+    // scrolling); ItemsIn over the whole width.
+    void  GetItemsInRange(int top, int bottom, Vector<int>& items) const;
+
+    // False when the rects of an item with spec s cannot depend on its
+    // min_size under c (fixed cell on both axes, stretched content), so the
+    // caller may skip querying it.
+    bool UsesMinSize(const FlowLayoutConfig& c, int i) const;
+
+    // Number of Solve passes that had to grow the scratch arena. Passes reuse
+    // the buffers of earlier ones, so this stays put in steady state (e.g. a
+    // second replan at the same size allocates nothing).
+    int   GetScratchAllocs() const         { return scratch_allocs; }
+
+    // Plan cache: the complete plans of up to 'plans' earlier inner sizes
+    // (or configurations) are kept, least recently used dropped first, in at
+    // most max_kb of cells and rows. Solve adopts one when it comes back to
+    // its size with no item changed in between (splitter drags, side panels
+    // toggled), so the pass is a lookup. Off (0 plans) by default.
+    void  SetPlanCache(int plans, int max_kb = 4096);
+    int   GetPlanCacheCount() const        { return saved.GetCount(); }
+
+    // Vectorized distribution of extra space to expanding items (AVX2 or
+    // SSE2 when the build targets them, scalar otherwise). Results are the
+    // same either way; turning it off forces the plain loops, e.g. to compare
+    // or benchmark them. Per solver, so solvers on other threads are not
+    // affected.
+    void  SetSimd(bool on)                 { simd = on; }
+    bool  IsSimd() const                   { return simd; }
+
+    // The distribution step itself, on packed arrays: shares remainder among
+    // n expanding items by weight, freezing those that reach their max cap
+    // and giving the rest what they cannot take (caps [lo[k], hi[k]],
+    // INT_MIN/INT_MAX for none); returns the pixels used, all of them unless
+    // every item is capped. O(n log n). Solve runs it per row (H) or stack (V).
+    static int  Distribute(int* size, const int* weight, const int* lo, const int* hi,
+                           int n, int remainder, bool simd = true);
+
+    // Clamp helper that respects “unset” (-1) semantics on min/max.
+    static int ClampWith(int minv, int maxv, int v) {
+        if(minv >= 0) v = max(v, minv);
+        if(maxv >= 0) v = min(v, maxv);
+        return v;
+    }
+
+private:
+    // Item storage (see Storage above). The flags byte packs the kind, the
+    // booleans and align_self; caps live in 'caps' at item_caps[i], -1 if
+    // the item has the default ones.
+    enum {
+        F_KIND    = 0x03,
+        F_VISIBLE = 0x04,
+        F_FIT     = 0x08,
+        F_HFW     = 0x10,
+        F_ALIGN_SHIFT = 5
+    };
+    struct Caps : Moveable<Caps> {
+        int minw = -1, maxw = 2048, minh = -1, maxh = INT_MAX;
+        bool IsDefault() const { return minw == -1 && maxw == 2048 && minh == -1 && maxh == INT_MAX; }
+    };
+
+    Vector<byte>  item_flags;
+    Vector<int>   item_fixed;
+    Vector<int>   item_weight;
+    Vector<Size>  item_min;
+    Vector<int>   item_caps;
+    Vector<Caps>  caps;            // side table (entries are reused, never removed)
+    Vector<int>   caps_free;       // released entries of 'caps'
+
+    int   Kind(int i) const        { return item_flags[i] & F_KIND; }
+    bool  Fit(int i) const         { return item_flags[i] & F_FIT; }
+    Align AlignSelf(int i) const   { return Align(item_flags[i] >> F_ALIGN_SHIFT); }
+    const Caps& CapsOf(int i) const {
+        static const Caps none;
+        return item_caps[i] < 0 ? none : caps[item_caps[i]];
+    }
+    void  Store(int i, const FlowItemSpec& s);
+
+    // Per-pass working storage (see Scratch)
+    struct RowCell {
+        int   idx   = -1;
+        bool  is_ctrl = false;
+        int   w     = 0;
+        int   base_h= 0;
+        int   hmin  = -1, hmax = INT_MAX;
+        Align self_align = Align::Auto;
+    };
+    struct GapExp { int idx; int weight; int minw; };
+    struct VCell  { int idx; int h; int wshare; };
+
+    void SolvePass(const FlowLayoutConfig& c, const Rect& inner);
+    void Replan(const FlowLayoutConfig& c, const Rect& inner);
+    bool AdoptProbe(const FlowLayoutConfig& c, const Rect& inner);
+    bool AdoptSaved(const FlowLayoutConfig& c, const Rect& inner);
+    bool Reflow(const FlowLayoutConfig& c, const Rect& inner);
+    void SavePlan();
+    void MoveOrigin(Point origin);
+    int  GetScratchCapacity() const;
+    bool MarkItem(int i);
+    void LayoutHorizontal(const Rect& irc, int inner_w, int inner_h,
+                          int first_row = 0, int stop_after = INT_MAX);
+    void LayoutVertical  (const Rect& irc, int inner_w, int inner_h);
+    void LayoutColumns   (const Rect& irc, int inner_h);
+    int  ColumnItemWidth(int i) const;
+    bool IsGridConfig(const FlowLayoutConfig& c) const;
+    bool IsGridItem(int i) const;
+    void LayoutGrid(const Rect& irc, int lo, int hi, bool full);
+    bool IsMasonryConfig(const FlowLayoutConfig& c) const;
+    void LayoutMasonry(const Rect& irc, int from);
+    int  MasonryCellHeight(int i, int cw);
+    bool IsJustifiedConfig(const FlowLayoutConfig& c) const;
+    void LayoutJustified(const Rect& irc, int from);
+    bool ResumeJustified(const Rect& irc);
+    Rect RowContent(int i, int x, int y, int w, int row_h) const;
+    int  RowBaseWidth(int i, int inner_h);
+    int  PlaceRow(RowCell* R, int ncells, GapExp* GE, int ngaps,
+                  const Rect& irc, int inner_w, int y, int row_h, int row);
+    int  CountExpanders(const RowCell* R, int ncells, int ngaps) const;
+    void UpdateRowsRange();
+    void BalanceRows(int first_row, int inner_w);
+    bool BalanceSection(int r0, int r1, int inner_w);
+    bool ResumeHorizontal(const Rect& irc, int inner_w, int inner_h);
+    bool ResumeVertical  (const Rect& irc, int inner_w, int inner_h);
+    int  StackCellHeight(int i, int inner_w, int& wshare);
+    int  PlaceStackCell(int i, const Rect& irc, int inner_w, int y, int h, int k);
+    void ClearDirty()       { plan.dirty_lo = INT_MAX; plan.dirty_hi = -1; plan.dirty_all = false; }
+
+    Align EffAlign(int i) const {
+        const Align a = AlignSelf(i);
+        return (a != Auto) ? a : plan.cfg.align_items;
+    }
+
+    // One layout of all items: results plus what a replan needs to resume.
+    struct Plan {
+        Vector<FlowCell> cells;
+        FlowLayoutConfig cfg;
+
+        // Layout results
+        int          used_w = 0, used_h = 0;
+        Size         inner  = Size(0,0);
+        Point        origin = Point(0,0);     // top-left of the inner rect
+
+        // Dirty item range since this plan was made
+        int          dirty_lo   = INT_MAX;
+        int          dirty_hi   = -1;
+        bool         dirty_all  = true;
+
+        // Row plan (H): first item, top, height and used width of each row.
+        // Lets a replan resume from the first affected row.
+        Vector<int>  row_first;
+        Vector<int>  row_top;
+        Vector<int>  row_h;
+        Vector<int>  row_w;
+
+        // Widths the rows hold at (see GetRowsMinWidth): per row, the end of
+        // its furthest item and the end the item that broke it would have
+        // had (INT_MAX: none), and the cells sharing its remainder; overall
+        // the widths [rows_lo, rows_hi].
+        Vector<int>  row_fit;
+        Vector<int>  row_brk;
+        Vector<int>  row_exp;
+        int          rows_lo = 0;
+        int          rows_hi = -1;
+
+        // Stack plan (V): whether expanders share a remainder (then any
+        // change moves every cell) and the bottom of the last cell.
+        bool         v_flex   = true;
+        int          v_bottom = 0;
+
+        // Rows did not depend on the inner height, columns (V + wrap) not
+        // on the inner width (see Measure)
+        bool         height_free = false;
+        bool         width_free  = false;
+
+        // Uniform grid (see IsGrid): columns, 0 if not a grid, and cell size
+        int          grid_cols = 0;
+        Size         grid_cell = Size(0,0);
+
+        // Masonry (see IsMasonry): columns, 0 if not a masonry, and the
+        // items planned; per column the top of its next item and its items
+        // top to bottom
+        int          mas_cols  = 0;
+        int          mas_count = 0;
+        Vector<int>  col_bottom;
+        Vector< Vector<int> > col_items;
+
+        // Justified rows (see IsJustified): the photos (visible content
+        // items) in order, prefix sums of their aspect ratios and the first
+        // photo of the section (run between breaks) of each; per position p
+        // (before photo p) the least cost of rows over photos [0, p) and
+        // where the last of them starts; the first photo of each row. The
+        // first jr_count items are planned, the next photo starts a
+        // section at jr_sect_next.
+        int            jr_count     = 0;
+        int            jr_sect_next = 0;
+        Vector<int>    jr_item;
+        Vector<double> jr_ar;
+        Vector<int>    jr_sect;
+        Vector<double> jr_cost;
+        Vector<int>    jr_prev;
+        Vector<int>    jr_row;
+
+        // Plan cache entry: solver revision it is valid for, last use
+        int          rev   = 0;
+        int          stamp = 0;
+
+        void Invalidate(int i) { dirty_lo = min(dirty_lo, i); dirty_hi = max(dirty_hi, i); }
+        bool IsClean() const   { return !dirty_all && dirty_lo == INT_MAX; }
+        int64 GetBytes() const;
+    };
+
+    // The committed plan (what GetCell & co. report) and the measuring one.
+    // The algorithms always work on 'plan'; Measure swaps the probe in.
+    Plan         plan;
+    Plan         probe;
+    void         ShiftItems(Plan& p, int i, int delta);
+
+    // Plan cache (see SetPlanCache). Every item change bumps 'rev', so an
+    // entry of another revision can never be adopted again.
+    Array<Plan>  saved;
+    int          saved_max    = 0;
+    int          saved_max_kb = 4096;
+    int          rev          = 0;
+    int          stamp        = 0;
+
+    // Scratch arena: reset with Trim (keeps the allocation) at the start of
+    // each pass, so steady-state passes do not touch the heap. Rows are flat:
+    // row r owns cells[cell_at[r] .. cell_at[r+1]) and likewise for gaps.
+    struct Scratch {
+        Vector<RowCell> cells;
+        Vector<int>     cell_at;      // (V + wrap: first stack entry of each column)
+        Vector<GapExp>  gaps;         // spacers / breaks sharing the row remainder
+        Vector<int>     gap_at;
+        Vector<int>     row_first;    // first item of each rebuilt row
+        Vector<int>     row_h_base;
+        Vector<int>     row_h_final;
+        Vector<int>     row_top;
+        Vector<int>     row_h;
+        Vector<int>     row_w;
+        Vector<int>     row_fit;
+        Vector<int>     row_brk;
+        Vector<int>     row_exp;
+        Vector<int>     exp_idx;      // expanding cells of the current row
+        Vector<int>     exp_size;     // expanding items, packed (see DistributeExpand)
+        Vector<int>     exp_weight;
+        Vector<int>     exp_min;
+        Vector<int>     exp_max;
+        Vector<int>     exp_order;    // by saturation rate (see DistributeExpand)
+        Vector<int>     tail;         // kept plan rows while splicing
+        Vector<VCell>   stack;        // V: visible cells top to bottom
+        Vector<int>     heap;         // masonry: columns by bottom
+        Vector<int>     bal_pos;      // balanced wrap: break points, best previous one,
+        Vector<int>     bal_prev;     // rows up to each
+        Vector<int>     bal_rows;
+        Vector<int64>   bal_x;        // ... and prefix widths, least cost up to each
+        Vector<int64>   bal_cost;
+    };
+    Scratch      scratch;
+    int          scratch_allocs = 0;
+
+    // Hit index of the committed plan (see ItemAt): band b holds items
+    // [band_at[b], band_at[b + 1]) and spans [band_lo[b], band_hi[b]) across
+    // (y for rows, x for columns); at[k] is where the cell of items[k]
+    // starts along its band. Dropped by every Solve and item change.
+    struct HitIndex {
+        bool        valid   = false;
+        bool        columns = false;
+        Vector<int> band_at;
+        Vector<int> band_lo;
+        Vector<int> band_hi;
+        Vector<int> items;
+        Vector<int> at;
+    };
+    mutable HitIndex hits;
+    void BuildHits() const;
+
+    bool         simd = true;          // see SetSimd
+
+    // Expand distribution over the packed exp_* arrays (see the .cpp)
+    void ClearExpand();
+    void AddExpand(int size, int weight, int minv, int maxv);
+    int  DistributeExpand(int remainder);
+};
+
+} // namespace Upp
+
+#endif // _FlowLayoutSolver_FlowLayoutSolver_h_
@@ -0,0 +1,64 @@
+#include <CtrlLib/CtrlLib.h>
+#include <FlowBoxLayout/FlowBoxLayout.h>
+
+using namespace Upp;
+
+// A property sheet as one V flow with SetWrap: ten 20 px high rows of
+// different widths and a gap of 4, so a column holds as many rows as
+// fit the height and is as wide as its widest row.
+
+struct Field : Ctrl {
+    int cx;
+
+    Size GetMinSize() const override { return Size(cx, 20); }
+};
+
+struct Sheet : FlowBoxLayout {
+    Array<Field> fields;
+
+    Sheet(int break_at = -1) : FlowBoxLayout(V) {
+        SetDeferredLayout(false);
+        SetWrap().SetWrapAutoResize().SetGap(4);
+        for(int cx : { 30, 60, 40, 20, 20, 30, 20, 10, 70, 40 }) {
+            if(fields.GetCount() == break_at)
+                AddBreak();
+            Field& f = fields.Add();
+            f.cx = cx;
+            AddFit(f);
+        }
+    }
+
+    Point At(int i) const { return fields[i].GetRect().TopLeft(); }
+};
+
+GUI_APP_MAIN
+{
+    Sheet sheet;
+    sheet.SetRect(0, 0, 400, 100);
+
+    // 100 high: four rows a column (4 * 20 + 3 * 4 = 92), columns of
+    // 60, 30 and 70 at x 0, 64 and 98
+    ASSERT(sheet.At(0) == Point(0, 0));
+    ASSERT(sheet.At(3) == Point(0, 72));
+    ASSERT(sheet.At(4) == Point(64, 0));
+    ASSERT(sheet.At(7) == Point(64, 72));
+    ASSERT(sheet.At(8) == Point(98, 0));
+    ASSERT(sheet.At(9) == Point(98, 24));
+    ASSERT(sheet.GetUsedWidth() == 168 && sheet.GetUsedHeight() == 92);
+
+    // width-for-height: the columns needed at a height, from any width
+    ASSERT(sheet.GetWidthForHeight(100) == 168);
+    ASSERT(sheet.GetWidthForHeight(52) == 60 + 40 + 30 + 20 + 70 + 4 * 4);
+    ASSERT(sheet.GetWidthForHeight(400) == 70);
+    ASSERT(sheet.GetMinSize().cx == 168);
+
+    // a break starts a new column: 0-1 | 2-5 | 6-9
+    Sheet broken(2);
+    broken.SetRect(0, 0, 400, 100);
+    ASSERT(broken.At(1) == Point(0, 24));
+    ASSERT(broken.At(2) == Point(64, 0));
+    ASSERT(broken.At(6) == Point(108, 0));
+    ASSERT(broken.GetUsedWidth() == 178);
+
+    LOG("============ OK");
+}
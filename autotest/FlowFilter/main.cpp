@@ -0,0 +1,63 @@
+#include <CtrlLib/CtrlLib.h>
+#include <FlowBoxLayout/FlowBoxLayout.h>
+
+using namespace Upp;
+
+// SetFilter with an index predicate: outcomes follow the items when
+// edits shift their indices, and filtered-out items (Ctrls or
+// virtual) leave the min size.
+
+struct Box : Ctrl {
+    Size GetMinSize() const override { return Size(30, 10); }
+};
+
+// 'shown' of the children in item order, as "+-+"
+static String Shown(FlowBoxLayout& fb, Array<Box>& boxes)
+{
+    String s;
+    for(Box& b : boxes)
+        s << (b.IsShown() ? '+' : '-');
+    return s;
+}
+
+GUI_APP_MAIN
+{
+    FlowBoxLayout fb(FlowBoxLayout::H);
+    fb.SetDeferredLayout(false);
+    Array<Box> boxes;
+    for(int i = 0; i < 5; ++i)
+        fb.AddFit(boxes.Add());
+    fb.SetRect(0, 0, 400, 100);
+
+    fb.SetFilter([](int i) { return i != 2; });
+    ASSERT(Shown(fb, boxes) == "++-++");
+    ASSERT(fb.IsFilteredOut(2) && !fb.IsFilteredOut(3));
+
+    boxes.Insert(0);                   // now at index 0; the others move up
+    fb.Insert(0, boxes[0]).Fit();
+    ASSERT(Shown(fb, boxes) == "++-+++");
+
+    fb.Remove(fb.GetHandle(0));
+    boxes.Remove(0);
+    ASSERT(Shown(fb, boxes) == "++-++");
+
+    fb.Move(4, 0);
+    boxes.Move(4, 0);
+    ASSERT(Shown(fb, boxes) == "++-++");
+
+    fb.ClearFilter();
+    ASSERT(Shown(fb, boxes) == "+++++");
+
+    // virtual items have no Ctrl to hide: the min size goes by the plan
+    FlowBoxLayout v(FlowBoxLayout::V);
+    v.SetGap(2);
+    v.SetVirtual(10, [](int, FlowBoxLayout::VirtualItem& it) { it.min_size = Size(20, 10); },
+                 [] { return new Box; }, [](int, Ctrl&) {});
+    ASSERT(v.GetMinSize() == Size(20, 10 * 10 + 9 * 2));
+    v.SetFilter([](int i) { return i % 2 == 0; });
+    ASSERT(v.GetMinSize() == Size(20, 5 * 10 + 4 * 2));
+    v.ClearFilter();
+    ASSERT(v.GetMinSize() == Size(20, 10 * 10 + 9 * 2));
+
+    LOG("============ OK");
+}
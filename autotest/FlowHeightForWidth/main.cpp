@@ -0,0 +1,124 @@
+#include <CtrlLib/CtrlLib.h>
+#include <FlowBoxLayout/FlowBoxLayout.h>
+
+using namespace Upp;
+
+// Children sized along one axis by the other (FlowConstraintSize): a
+// paragraph of 'chars' 8 px characters in 16 px lines wraps to the
+// width it gets; the answers are cached until the width changes or the
+// min size is invalidated.
+
+struct Para : Ctrl, FlowConstraintSize {
+    int chars;
+    int asked = 0;
+
+    Size GetMinSize() const override { return Size(8, 16); }
+    int GetHeightForWidth(int width) override {
+        ++asked;
+        const int per_line = max(1, width / 8);
+        return 16 * ((chars + per_line - 1) / per_line);
+    }
+    int GetWidthForHeight(int height) override {
+        ++asked;
+        const int lines = max(1, height / 16);
+        return 8 * ((chars + lines - 1) / lines);
+    }
+    Para(int chars) : chars(chars) {}
+};
+
+// V stack: the height at the cell width
+static void Stack()
+{
+    FlowBoxLayout fb(FlowBoxLayout::V);
+    fb.SetDeferredLayout(false);
+    Para p(60);
+    fb.AddFit(p);
+    fb.SetRect(0, 0, 200, 400);
+    ASSERT(p.GetRect() == RectC(0, 0, 200, 48));    // 25 a line: 3 lines
+
+    fb.SetRect(0, 0, 80, 400);
+    ASSERT(p.GetRect().GetHeight() == 96);           // 10 a line: 6 lines
+
+    const int asked = p.asked;
+    fb.SetRect(0, 0, 80, 300);                       // same width: cached
+    ASSERT(p.asked == asked && p.GetRect().GetHeight() == 96);
+
+    p.chars = 20;
+    fb.InvalidateMinSize(p);
+    fb.Layout();
+    ASSERT(p.asked > asked && p.GetRect().GetHeight() == 32);
+}
+
+// H row: the width at the inner height
+static void Row()
+{
+    FlowBoxLayout fb(FlowBoxLayout::H);
+    fb.SetDeferredLayout(false);
+    Para p(60);
+    fb.AddFit(p);
+    fb.SetRect(0, 0, 800, 48);
+    ASSERT(p.GetRect().GetWidth() == 160);           // 3 lines of 20
+}
+
+// a Ctrl without the interface, sized through ItemRef::ConstraintSize
+struct Line : Ctrl {
+    Size GetMinSize() const override { return Size(8, 16); }
+};
+
+static void Helper()
+{
+    FlowBoxLayout fb(FlowBoxLayout::V);
+    fb.SetDeferredLayout(false);
+    Line plain;
+    Para sizer(60);
+    FlowBoxLayout::ItemRef item = fb.AddFit(plain);
+    item.ConstraintSize(&sizer);
+    fb.SetRect(0, 0, 200, 400);
+    ASSERT(plain.GetRect().GetHeight() == 48);
+
+    item.ConstraintSize(nullptr);
+    fb.Layout();
+    ASSERT(plain.GetRect().GetHeight() == 16);       // min size only
+}
+
+// masonry: every item at the column width
+static void Masonry()
+{
+    FlowBoxLayout fb(FlowBoxLayout::H);
+    fb.SetDeferredLayout(false);
+    fb.SetWrap().SetFixedColumn(80).SetMasonry();
+    Array<Para> p;
+    for(int chars : { 30, 10, 50 })
+        fb.AddFit(p.Create<Para>(chars));
+    fb.SetRect(0, 0, 160, 400);
+    ASSERT(p[0].GetRect() == RectC(0, 0, 80, 48));   // 10 a line
+    ASSERT(p[1].GetRect() == RectC(80, 0, 80, 16));
+    ASSERT(p[2].GetRect() == RectC(80, 16, 80, 80)); // under the shorter column
+}
+
+// an auto-resizing wrapped flow nested in a V stack is one of them
+static void Nested()
+{
+    FlowBoxLayout outer(FlowBoxLayout::V), inner(FlowBoxLayout::H);
+    outer.SetDeferredLayout(false);
+    inner.SetDeferredLayout(false);
+    inner.SetWrap().SetWrapAutoResize();
+    Line words[6];
+    for(Line& w : words)
+        inner.AddFit(w);                             // 8 x 16 each
+    outer.AddFit(inner);
+    outer.SetRect(0, 0, 240, 400);
+    ASSERT(inner.GetRect().GetHeight() == 16);       // one row of 6
+    outer.SetRect(0, 0, 16, 400);
+    ASSERT(inner.GetRect().GetHeight() == 48);       // three rows of 2
+}
+
+GUI_APP_MAIN
+{
+    Stack();
+    Row();
+    Helper();
+    Masonry();
+    Nested();
+    LOG("============ OK");
+}
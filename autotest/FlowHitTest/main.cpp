@@ -0,0 +1,116 @@
+#include <Core/Core.h>
+#include <FlowLayoutSolver/FlowLayoutSolver.h>
+
+using namespace Upp;
+
+// --------------------------------------------------------------
+// The hit index (rows, or columns for masonry and V) answers the
+// same as a scan over every cell: ItemAt, ItemsIn and GetItemRect
+// on random plans of each layout mode, probed at random points and
+// rects in and around the used area.
+// --------------------------------------------------------------
+
+static int failures = 0;
+
+static void Fail(const char *mode, int run, const String& what)
+{
+    if(failures++ < 10)
+        Cout() << mode << ", run " << run << ": " << what << "\n";
+}
+
+static bool Hittable(const FlowLayoutSolver& s, int i)
+{
+    const FlowCell& cl = s.GetCell(i);
+    return cl.visible && cl.placed && s.GetSpec(i).kind == FlowItemSpec::CONTENT;
+}
+
+static int ScanAt(const FlowLayoutSolver& s, Point p)
+{
+    for(int i = 0; i < s.GetCount(); ++i)
+        if(Hittable(s, i) && s.GetCell(i).cell.Contains(p))
+            return i;
+    return -1;
+}
+
+static void ScanIn(const FlowLayoutSolver& s, const Rect& r, Vector<int>& items)
+{
+    items.Clear();
+    for(int i = 0; i < s.GetCount(); ++i)
+        if(Hittable(s, i) && s.GetCell(i).cell.Intersects(r))
+            items.Add(i);
+}
+
+static Rect Around(const FlowLayoutSolver& s, const Rect& irc)
+{
+    return RectC(irc.left - 10, irc.top - 10, s.GetUsedWidth() + 20, s.GetUsedHeight() + 20);
+}
+
+CONSOLE_APP_MAIN
+{
+    static const struct {
+        const char *name;
+        bool        v, wrap, masonry;
+        int         fixed_column, justify_row;
+    } modes[] = {
+        { "H",              false, false, false, -1,  0 },
+        { "H + wrap",       false, true,  false, -1,  0 },
+        { "H + wrap, grid", false, true,  false, 40,  0 },
+        { "masonry",        false, true,  true,  40,  0 },
+        { "justified",      false, true,  false, -1, 60 },
+        { "V",              true,  false, false, -1,  0 },
+        { "V + wrap",       true,  true,  false, -1,  0 },
+    };
+
+    for(const auto& m : modes)
+        for(int run = 1; run <= 60; ++run) {
+            FlowLayoutConfig cfg;
+            cfg.dir = m.v ? FlowLayoutTypes::V : FlowLayoutTypes::H;
+            cfg.wrap = m.wrap;
+            cfg.masonry = m.masonry;
+            cfg.fixed_column = m.fixed_column;
+            cfg.justify_row = m.justify_row;
+            cfg.gap = Random(5);
+            cfg.align_items = (FlowLayoutTypes::Align)(1 + Random(4));
+            if(!m.masonry && !m.justify_row && Random(4) == 0)
+                cfg.fixed_row = 20 + Random(20);
+            const Rect irc = RectC(Random(10), Random(10), 100 + Random(500), 100 + Random(500));
+
+            FlowLayoutSolver s;
+            for(int i = 1 + Random(200); i > 0; --i) {
+                FlowItemSpec sp;
+                const int k = Random(30);
+                sp.kind = k == 0 ? FlowItemSpec::SPACER : k == 1 ? FlowItemSpec::BREAK : FlowItemSpec::CONTENT;
+                sp.visible = Random(10) != 0;
+                sp.fit = Random(2);
+                if(!sp.fit && Random(2))
+                    sp.expandingWeight = 1 + Random(3);
+                sp.min_size = Size(5 + Random(60), 5 + Random(40));
+                s.Add(sp);
+            }
+            s.Solve(cfg, irc);
+
+            const Rect area = Around(s, irc);
+            Vector<int> got, want;
+            for(int q = 0; q < 100; ++q) {
+                const Point p(area.left + Random(area.GetWidth()), area.top + Random(area.GetHeight()));
+                const int a = s.ItemAt(p), b = ScanAt(s, p);
+                if(a != b)
+                    Fail(m.name, run, Format("ItemAt(%d, %d) is %d, scan %d", p.x, p.y, a, b));
+
+                Rect r = RectC(p.x, p.y, Random(area.GetWidth() / 2), Random(area.GetHeight() / 2));
+                s.ItemsIn(r, got);
+                ScanIn(s, r, want);
+                if(got != want)
+                    Fail(m.name, run, Format("ItemsIn at (%d, %d): %d items, scan %d",
+                                             p.x, p.y, got.GetCount(), want.GetCount()));
+            }
+            for(int i = 0; i < s.GetCount(); ++i) {
+                const FlowCell& cl = s.GetCell(i);
+                if(cl.placed ? s.GetItemRect(i) != cl.cell : !IsNull(s.GetItemRect(i)))
+                    Fail(m.name, run, Format("GetItemRect(%d)", i));
+            }
+        }
+
+    Cout() << (failures ? "FAILED" : "OK") << " (" << failures << " failures)\n";
+    SetExitCode(failures ? 1 : 0);
+}
@@ -0,0 +1,122 @@
+#include <Core/Core.h>
+#include <FlowLayoutSolver/FlowLayoutSolver.h>
+
+using namespace Upp;
+
+// --------------------------------------------------------------
+// Justified rows: random galleries (with breaks and hidden photos)
+// must keep these properties of every plan:
+//  - a row is one band: same top and height, cells gap apart from
+//    the left edge, rows gap apart from the top;
+//  - a photo keeps the aspect ratio of its min size (to rounding);
+//  - a row that does not end its section fills the width exactly
+//    and is no lower than half the target;
+//  - a row ending its section (break or last photo) is not
+//    stretched past the target.
+// --------------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(c) \
+    do { \
+        if(!(c) && failures++ < 10) \
+            Cout() << "run " << run << ", row " << r << ": " #c "\n"; \
+    } while(0)
+
+static void Check(const FlowLayoutSolver& s, const Rect& irc, int gap, int target, int run)
+{
+    // visible photos by row, and whether the row ends its section
+    Vector< Vector<int> > rows;
+    Vector<bool> last;
+    for(int i = 0; i < s.GetCount(); ++i) {
+        const FlowItemSpec sp = s.GetSpec(i);
+        if(sp.kind == FlowItemSpec::BREAK && rows.GetCount())
+            last.Top() = true;
+        if(sp.kind != FlowItemSpec::CONTENT || !sp.visible) continue;
+        const int r = s.GetCell(i).rowOrCol;
+        if(r >= rows.GetCount()) {
+            rows.SetCount(r + 1);
+            last.SetCount(r + 1, false);
+        }
+        rows[r].Add(i);
+    }
+    if(last.GetCount())
+        last.Top() = true;
+
+    int y = irc.top;
+    int r = 0;
+    for(; r < rows.GetCount(); ++r) {
+        CHECK(rows[r].GetCount() > 0);
+        if(rows[r].IsEmpty()) continue;
+        const int h = s.GetCell(rows[r][0]).cell.GetHeight();
+        int x = irc.left;
+        for(int i : rows[r]) {
+            const Rect& c = s.GetCell(i).cell;
+            const Size ms = s.GetSpec(i).min_size;
+            const double ar = (double)ms.cx / ms.cy;
+            CHECK(c.top == y && c.GetHeight() == h && c.left == x);
+            CHECK(fabs(c.GetWidth() - ar * h) <= 1 + ar / 2);
+            x = c.right + gap;
+        }
+        if(last[r])
+            CHECK(h <= target);
+        else {
+            CHECK(x - gap == irc.right);
+            CHECK(rows[r].GetCount() == 1 || 2 * h >= target - 1);
+        }
+        y += h + gap;
+    }
+    CHECK(s.IsJustified());
+    CHECK(s.GetUsedHeight() == (rows.GetCount() ? y - gap - irc.top : 0));
+}
+
+static FlowItemSpec Photo(int cx, int cy)
+{
+    FlowItemSpec sp;
+    sp.min_size = Size(cx, cy);
+    return sp;
+}
+
+CONSOLE_APP_MAIN
+{
+    FlowLayoutConfig cfg;
+    cfg.dir = FlowLayoutTypes::H;
+    cfg.wrap = true;
+
+    // three squares in 302 with a gap of 1: one row exactly at the target
+    {
+        const int run = 0, r = 0;
+        cfg.gap = 1;
+        cfg.justify_row = 100;
+        FlowLayoutSolver s;
+        for(int i = 0; i < 3; ++i)
+            s.Add(Photo(10, 10));
+        s.Solve(cfg, RectC(0, 0, 302, 500));
+        CHECK(s.GetCell(0).cell == RectC(0, 0, 100, 100));
+        CHECK(s.GetCell(1).cell == RectC(101, 0, 100, 100));
+        CHECK(s.GetCell(2).cell == RectC(202, 0, 100, 100));
+
+        // one square alone would be 302 high: it stays at the target
+        s.SetCount(1);
+        s.Solve(cfg, RectC(0, 0, 302, 500));
+        CHECK(s.GetCell(0).cell == RectC(0, 0, 100, 100));
+    }
+
+    for(int run = 1; run <= 300; ++run) {
+        cfg.gap = Random(6);
+        cfg.justify_row = 40 + Random(120);
+        const Rect irc = RectC(Random(5), Random(5), 200 + Random(800), 10000);
+        FlowLayoutSolver s;
+        for(int i = 1 + Random(80); i > 0; --i) {
+            FlowItemSpec sp = Photo(20 + Random(300), 20 + Random(300));
+            if(Random(25) == 0) sp.kind = FlowItemSpec::BREAK;
+            else sp.visible = Random(10) != 0;
+            s.Add(sp);
+        }
+        s.Solve(cfg, irc);
+        Check(s, irc, cfg.gap, cfg.justify_row, run);
+    }
+
+    Cout() << (failures ? "FAILED" : "OK") << " (" << failures << " failures)\n";
+    SetExitCode(failures ? 1 : 0);
+}
@@ -0,0 +1,117 @@
+#include <Core/Core.h>
+#include <FlowLayoutSolver/FlowLayoutSolver.h>
+
+using namespace Upp;
+
+// --------------------------------------------------------------
+// Masonry: each item goes under the column that ends highest
+// (leftmost on ties), a break levels the columns, spacers take no
+// room. A hand-worked plan, then random ones against a plain
+// scan over the columns.
+// --------------------------------------------------------------
+
+static int failures = 0;
+
+static void Expect(bool ok, const String& what)
+{
+    if(!ok && failures++ < 10)
+        Cout() << "failed: " << what << "\n";
+}
+
+static FlowLayoutConfig Masonry(int column, int gap)
+{
+    FlowLayoutConfig cfg;
+    cfg.dir = FlowLayoutTypes::H;
+    cfg.wrap = true;
+    cfg.masonry = true;
+    cfg.fixed_column = column;
+    cfg.gap = gap;
+    return cfg;
+}
+
+static FlowItemSpec Tile(int h)
+{
+    FlowItemSpec sp;
+    sp.min_size = Size(10, h);
+    return sp;
+}
+
+static FlowItemSpec Kind(FlowItemSpec::Kind k)
+{
+    FlowItemSpec sp;
+    sp.kind = k;
+    return sp;
+}
+
+// 3 columns of 50 with a gap of 10 in 170:
+//
+//   0: [0]  0..30                 [5] 40..50
+//   1: [1]  0..10  [3] 20..25
+//   2: [2]  0..20
+static void Worked()
+{
+    FlowLayoutSolver s;
+    for(int h : { 30, 10, 20, 5 })
+        s.Add(Tile(h));
+    s.Add(Kind(FlowItemSpec::BREAK));
+    s.Add(Tile(10));
+    s.Solve(Masonry(50, 10), RectC(0, 0, 170, 400));
+
+    Expect(s.IsMasonry() && s.GetMasonryColumns() == 3, "3 columns");
+    Expect(s.GetCell(0).cell == RectC(0, 0, 50, 30), "item 0 in column 0");
+    Expect(s.GetCell(1).cell == RectC(60, 0, 50, 10), "item 1 in column 1");
+    Expect(s.GetCell(2).cell == RectC(120, 0, 50, 20), "item 2 in column 2");
+    Expect(s.GetCell(3).cell == RectC(60, 20, 50, 5), "item 3 under the shortest column");
+    Expect(s.GetCell(4).breakMark && s.GetCell(4).cell.top == 40, "break at the longest column");
+    Expect(s.GetCell(5).cell == RectC(0, 40, 50, 10), "after the break: leftmost on ties");
+    Expect(s.GetUsedWidth() == 170 && s.GetUsedHeight() == 50, "used size");
+}
+
+CONSOLE_APP_MAIN
+{
+    Worked();
+
+    for(int run = 1; run <= 200; ++run) {
+        const int column = 20 + Random(40);
+        const int gap = Random(8);
+        const Rect irc = RectC(Random(5), Random(5), 50 + Random(400), 1000);
+        FlowLayoutSolver s;
+        for(int i = 1 + Random(60); i > 0; --i) {
+            const int k = Random(20);
+            s.Add(k == 0 ? Kind(FlowItemSpec::BREAK) : k == 1 ? Kind(FlowItemSpec::SPACER)
+                                                             : Tile(1 + Random(80)));
+        }
+        s.Solve(Masonry(column, gap), irc);
+
+        const int cols = max(1, 1 + (irc.GetWidth() - column) / (column + gap));
+        Expect(s.GetMasonryColumns() == cols, Format("run %d: column count", run));
+        Vector<int> bottom;
+        bottom.SetCount(cols, irc.top);
+        for(int i = 0; i < s.GetCount(); ++i) {
+            const FlowItemSpec& sp = s.GetSpec(i);
+            const FlowCell& cl = s.GetCell(i);
+            if(sp.kind == FlowItemSpec::SPACER)
+                continue;
+            if(sp.kind == FlowItemSpec::BREAK) {
+                int level = irc.top;
+                for(int b : bottom)
+                    level = max(level, b);
+                for(int& b : bottom)
+                    b = level;
+                Expect(cl.breakMark && cl.cell.top == level, Format("run %d: break %d", run, i));
+                continue;
+            }
+            int c = 0;
+            for(int q = 1; q < cols; ++q)
+                if(bottom[q] < bottom[c])
+                    c = q;
+            const int x = irc.left + c * (column + gap);
+            Expect(cl.rowOrCol == c && cl.cell == RectC(x, bottom[c], column, sp.min_size.cy),
+                   Format("run %d: item %d", run, i));
+            bottom[c] += sp.min_size.cy + gap;
+        }
+    }
+
+    Cout() << (failures ? "FAILED" : "OK") << " (" << failures << " failures)\n";
+    SetExitCode(failures ? 1 : 0);
+}
@@ -0,0 +1,82 @@
+#include <CtrlLib/CtrlLib.h>
+#include <FlowBoxLayout/FlowBoxLayout.h>
+
+using namespace Upp;
+
+// Move(from, to): the item order, the child (tab) order and the placed
+// rects follow it, and a focused child keeps the focus across the move.
+
+struct Tile : ParentCtrl {
+    char  name;
+    Ctrl  inner;                       // takes the focus
+
+    Size GetMinSize() const override { return Size(20, 10); }
+    Tile(char n) : name(n) { Add(inner.SizePos()); }
+};
+
+// names of the children of fb, in child order
+static String Children(FlowBoxLayout& fb)
+{
+    String s;
+    for(Ctrl *q = fb.GetFirstChild(); q; q = q->GetNext())
+        s.Cat(static_cast<Tile *>(q)->name);
+    return s;
+}
+
+// names of the tiles, left to right by where the layout placed them
+static String Placed(Array<Tile>& tiles)
+{
+    Vector<Tile *> t;
+    for(Tile& q : tiles)
+        t.Add(&q);
+    Sort(t, [](Tile *a, Tile *b) { return a->GetRect().left < b->GetRect().left; });
+    String s;
+    for(Tile *q : t)
+        s.Cat(q->name);
+    return s;
+}
+
+GUI_APP_MAIN
+{
+    static const struct { int from, to; const char *order; } moves[] = {
+        { 0, 4, "BCDEA" },             // first to last
+        { 4, 0, "ABCDE" },             // and back
+        { 1, 3, "ACDBE" },             // forward within
+        { 3, 1, "ABCDE" },             // backward within
+        { 2, 9, "ABDEC" },             // 'to' past the end is clamped
+        { 4, 4, "ABDEC" },             // no-op
+        { 9, 0, "ABDEC" },             // 'from' out of range is ignored
+    };
+
+    TopWindow win;
+    FlowBoxLayout fb(FlowBoxLayout::H);
+    fb.SetDeferredLayout(false);
+    win.Add(fb.SizePos());
+    win.SetRect(0, 0, 200, 40);
+    Array<Tile> tiles;
+    for(char n = 'A'; n <= 'E'; ++n)
+        fb.AddFit(tiles.Create<Tile>(n));
+    fb.SetRect(0, 0, 200, 40);
+    win.Open();
+
+    for(const auto& m : moves) {
+        fb.Move(m.from, m.to);
+        fb.Layout();
+        LOG(m.from << " -> " << m.to << ": " << Children(fb) << " / " << Placed(tiles));
+        ASSERT(Children(fb) == m.order);
+        ASSERT(Placed(tiles) == m.order);
+    }
+
+    Tile& b = tiles[1];
+    b.inner.SetFocus();
+    ASSERT(b.inner.HasFocus());
+    fb.Move(fb.IndexOf(b), 4);
+    ASSERT(Children(fb).Find('B') == 4);
+    ASSERT(b.inner.HasFocus());
+    fb.Move(4, 0);
+    ASSERT(Children(fb).Find('B') == 0);
+    ASSERT(b.inner.HasFocus());
+
+    win.Close();
+    LOG("============ OK");
+}
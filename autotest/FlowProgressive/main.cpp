@@ -0,0 +1,97 @@
+#include <CtrlLib/CtrlLib.h>
+#include <FlowBoxLayout/FlowBoxLayout.h>
+
+using namespace Upp;
+
+// SetProgressiveLayout on 3000 children that are slow to measure: the
+// first pass stops at the budget with the viewport committed and the
+// plan provisional, later ticks finish it, a resize mid-way restarts
+// it, and the end result is the one a single pass gives.
+
+static bool slow;
+
+struct Tile : Ctrl {
+    Size size;
+
+    Size GetMinSize() const override {
+        for(int64 t = usecs() + 20; slow && usecs() < t;)
+            ;
+        return size;
+    }
+};
+
+struct Wall : FlowBoxLayout {
+    Array<Tile> tiles;
+
+    Wall() : FlowBoxLayout(H) {
+        SetWrap().SetGap(2);
+        for(int i = 0; i < 3000; ++i) {
+            Tile& t = tiles.Add();
+            t.size = Size(20 + i * 7 % 50, 20 + i % 3 * 4);
+            AddFit(t);
+        }
+    }
+};
+
+// the rects a single pass gives at 'width'
+static Vector<Rect> OnePass(int width)
+{
+    slow = false;
+    Wall w;
+    w.SetDeferredLayout(false);
+    w.SetRect(0, 0, width, 100000);
+    Vector<Rect> r;
+    for(Tile& t : w.tiles)
+        r.Add(t.GetRect());
+    return r;
+}
+
+static bool Same(Wall& w, const Vector<Rect>& r)
+{
+    for(int i = 0; i < r.GetCount(); ++i)
+        if(w.tiles[i].GetRect() != r[i])
+            return false;
+    return true;
+}
+
+GUI_APP_MAIN
+{
+    const Vector<Rect> at800 = OnePass(800), at600 = OnePass(600);
+
+    slow = true;
+    Wall w;
+    w.SetProgressiveLayout(true, 2);
+    w.SetViewport(RectC(0, 0, 800, 60));
+    w.SetRect(0, 0, 800, 100000);
+    w.FlushLayout();
+
+    // one pass of about 2 ms cannot measure 3000 * 20 us
+    ASSERT(w.IsLayoutProvisional());
+    ASSERT(w.tiles.Top().GetRect().IsEmpty());
+    Vector<int> vp;
+    w.ItemsIn(RectC(0, 0, 800, 60), vp);
+    ASSERT(vp.GetCount());
+    for(int i : vp)
+        ASSERT(w.tiles[i].GetRect() == w.GetItemRect(i));
+
+    // a few ticks, then a resize restarts the run
+    for(int k = 0; k < 3; ++k)
+        Ctrl::ProcessEvents();
+    ASSERT(w.IsLayoutProvisional());
+    w.SetRect(0, 0, 600, 100000);
+    int ticks = 0;
+    while(w.IsLayoutProvisional() && ticks++ < 100000)
+        Ctrl::ProcessEvents();
+    LOG("finished after " << ticks << " ticks");
+    ASSERT(!w.IsLayoutProvisional());
+    ASSERT(Same(w, at600));
+
+    // FinishLayout completes a run at once
+    w.SetRect(0, 0, 800, 100000);
+    w.FlushLayout();
+    w.FinishLayout();
+    ASSERT(!w.IsLayoutProvisional());
+    ASSERT(Same(w, at800));
+
+    LOG("============ OK");
+}
@@ -0,0 +1,97 @@
+#include <CtrlLib/CtrlLib.h>
+#include <FlowBoxLayout/FlowBoxLayout.h>
+
+using namespace Upp;
+
+// Reconcile over a live ticker: quotes come and go and change places.
+// Kept keys keep their Ctrl (and its cached min size), new keys are
+// created, gone keys deleted, and the children follow the keys.
+
+static int created, alive, measured;
+
+struct Quote : Ctrl {
+    String key, shown;
+
+    Size GetMinSize() const override { ++measured; return Size(40, 20); }
+    Quote(const String& key) : key(key) { ++created; ++alive; }
+    ~Quote() { --alive; }
+};
+
+// keys of the children in child order, as "C A D"
+static String Children(FlowBoxLayout& fb)
+{
+    String s;
+    for(Ctrl *q = fb.GetFirstChild(); q; q = q->GetNext()) {
+        if(s.GetCount())
+            s << ' ';
+        Quote *t = dynamic_cast<Quote *>(q);
+        s << (t ? t->key : String("?"));
+    }
+    return s;
+}
+
+static Vector<String> Keys(const char *s)
+{
+    Vector<String> keys;
+    for(; *s; ++s)
+        if(*s != ' ')
+            keys.Add(String(s, 1));
+    return keys;
+}
+
+GUI_APP_MAIN
+{
+    {
+        FlowBoxLayout fb(FlowBoxLayout::H);
+        fb.SetDeferredLayout(false);
+        fb.SetRect(0, 0, 400, 40);
+
+        auto create = [](const String& k) -> Ctrl * { return k == "X" ? nullptr : new Quote(k); };
+        auto update = [](const String& k, Ctrl& c) {
+            Quote& q = dynamic_cast<Quote&>(c);
+            ASSERT(q.key == k);
+            q.shown = k;
+        };
+        auto sync = [&](const char *keys) {
+            fb.Reconcile(Keys(keys), create, update);
+            fb.Layout();
+        };
+
+        sync("A B C");
+        ASSERT(created == 3 && alive == 3);
+        ASSERT(Children(fb) == "A B C");
+        Ctrl *a = fb.GetKeyCtrl("A"), *c = fb.GetKeyCtrl("C");
+
+        // reorder, drop B, add D: A and C are the same Ctrls, not measured again
+        measured = 0;
+        sync("C A D");
+        ASSERT(created == 4 && alive == 3);
+        ASSERT(fb.GetKeyCtrl("A") == a && fb.GetKeyCtrl("C") == c && !fb.GetKeyCtrl("B"));
+        ASSERT(Children(fb) == "C A D");
+        ASSERT(measured == 1);         // D only
+        ASSERT(c->GetRect().left < a->GetRect().left &&
+               a->GetRect().left < fb.GetKeyCtrl("D")->GetRect().left);
+        ASSERT(dynamic_cast<Quote *>(fb.GetKeyCtrl("D"))->shown == "D");
+
+        // a key the factory declines is left out; a repeated key counts once
+        sync("X A A E");
+        ASSERT(Children(fb) == "A E");
+        ASSERT(!fb.GetKeyCtrl("X") && fb.GetKeyCtrl("A") == a);
+        ASSERT(created == 5 && alive == 2);
+
+        // an item not added by Reconcile is removed, but not deleted
+        Quote extra("Z");
+        fb.AddFit(extra);
+        sync("E A");
+        ASSERT(Children(fb) == "E A");
+        ASSERT(!extra.GetParent() && alive == 3);
+
+        sync("");
+        ASSERT(Children(fb) == "" && alive == 1);
+        sync("A");
+        ASSERT(created == 7 && alive == 2);  // A is new again
+    }
+    ASSERT(alive == 0);                // the container deletes what it owns
+
+    LOG("============ OK");
+}
@@ -0,0 +1,155 @@
+#include <Core/Core.h>
+#include <FlowLayoutSolver/FlowLayoutSolver.h>
+
+using namespace Upp;
+
+// --------------------------------------------------------------
+// Random edits (specs, visibility, min sizes, structure, count,
+// width) on a solver that resumes its plan, each followed by a Solve
+// whose cells and used size must equal those of a fresh solver
+// given the same specs.
+// --------------------------------------------------------------
+
+static int failures = 0;
+
+static FlowItemSpec RandomSpec()
+{
+    FlowItemSpec sp;
+    const int k = Random(20);
+    sp.kind = k == 0 ? FlowItemSpec::SPACER : k == 1 ? FlowItemSpec::BREAK : FlowItemSpec::CONTENT;
+    sp.visible = Random(8) != 0;
+    sp.fit = Random(2);
+    if(Random(6) == 0) sp.fixed = 10 + Random(40);
+    if(Random(8) == 0) sp.expandingWeight = 1 + Random(3);
+    sp.min_size = Size(5 + Random(80), 5 + Random(40));
+    return sp;
+}
+
+static FlowLayoutConfig RandomConfig()
+{
+    FlowLayoutConfig cfg;
+    cfg.dir = Random(2) ? FlowLayoutTypes::H : FlowLayoutTypes::V;
+    cfg.wrap = Random(2);
+    cfg.gap = Random(4);
+    cfg.align_items = (FlowLayoutTypes::Align)(1 + Random(4));
+    if(Random(4) == 0) cfg.fixed_column = 20 + Random(40);
+    if(Random(4) == 0) cfg.fixed_row = 10 + Random(30);
+    if(cfg.dir == FlowLayoutTypes::H && cfg.wrap)
+        switch(Random(5)) {
+        case 0: cfg.masonry = true; cfg.fixed_column = 20 + Random(40); break;
+        case 1: cfg.justify_row = 20 + Random(30); break;
+        case 2: cfg.wrap_balance = true; break;
+        case 3: cfg.wrap_rows_expand = true; break;
+        }
+    return cfg;
+}
+
+static void Compare(const FlowLayoutSolver& s, const FlowLayoutConfig& cfg, const Rect& irc,
+                    const char *what, int run)
+{
+    FlowLayoutSolver fresh;
+    for(int i = 0; i < s.GetCount(); ++i)
+        fresh.Add(s.GetSpec(i));
+    fresh.Solve(cfg, irc);
+
+    bool ok = s.GetUsedWidth() == fresh.GetUsedWidth() && s.GetUsedHeight() == fresh.GetUsedHeight();
+    for(int i = 0; i < s.GetCount() && ok; ++i) {
+        const FlowCell& a = s.GetCell(i);
+        const FlowCell& b = fresh.GetCell(i);
+        ok = a.visible == b.visible && (!a.visible || a.cell == b.cell && a.content == b.content);
+    }
+    if(!ok && failures++ < 10)
+        Cout() << "run " << run << ", " << what << ": used "
+               << s.GetUsedWidth() << "x" << s.GetUsedHeight() << ", fresh "
+               << fresh.GetUsedWidth() << "x" << fresh.GetUsedHeight() << "\n";
+}
+
+// The cases this test was written for: edits that leave nothing
+// visible, a shrinking count and the widest item of a stack
+// turning into a spacer.
+static void Cases()
+{
+    FlowLayoutConfig h;
+    h.dir = FlowLayoutTypes::H;
+    const Rect irc = RectC(0, 0, 300, 344);
+
+    FlowItemSpec sp;
+    sp.min_size = Size(40, 20);
+    FlowLayoutSolver s;
+    s.Add(sp);
+    s.Solve(h, irc);
+    s.SetVisible(0, false);
+    s.Solve(h, irc);
+    Compare(s, h, irc, "H, the only item hidden", 0);
+    s.SetVisible(0, true);
+    s.Solve(h, irc);
+    s.SetCount(0);
+    s.Solve(h, irc);
+    Compare(s, h, irc, "H, SetCount(0)", 0);
+    s.Add(sp);
+    s.Solve(h, irc);
+    s.Remove(0);
+    s.Solve(h, irc);
+    Compare(s, h, irc, "H, last item removed", 0);
+
+    FlowLayoutConfig v;
+    v.dir = FlowLayoutTypes::V;
+    v.align_items = FlowLayoutTypes::Start;
+    s.Clear();
+    for(int w : { 42, 100, 57, 385 }) {
+        sp.min_size = Size(w, 20);
+        s.Add(sp);
+    }
+    s.Solve(v, irc);
+    s.SetCount(2);
+    s.Solve(v, irc);
+    Compare(s, v, irc, "V, count shrinks", 0);
+    v.fixed_row = 20;                  // spacers take no share: the pass resumes
+    s.Clear();
+    for(int w : { 42, 57 }) {
+        sp.min_size = Size(w, 20);
+        s.Add(sp);
+    }
+    s.Solve(v, irc);
+    FlowItemSpec spacer = s.GetSpec(1);
+    spacer.kind = FlowItemSpec::SPACER;
+    s.SetSpec(1, spacer);
+    s.Solve(v, irc);
+    Compare(s, v, irc, "V, widest item becomes a spacer", 0);
+}
+
+CONSOLE_APP_MAIN
+{
+    Cases();
+
+    for(int run = 1; run <= 400; ++run) {
+        const FlowLayoutConfig cfg = RandomConfig();
+        Rect irc = RectC(Random(5), Random(5), 100 + Random(300), 200 + Random(400));
+        FlowLayoutSolver s;
+        const int n = Random(30);
+        for(int i = 0; i < n; ++i)
+            s.Add(RandomSpec());
+        s.Solve(cfg, irc);
+
+        for(int step = 0; step < 30; ++step) {
+            const int count = s.GetCount();
+            const int i = count ? Random(count) : 0;
+            const char *what;
+            switch(Random(8)) {
+            case 0:  what = "SetVisible"; if(count) s.SetVisible(i, !s.IsVisible(i)); break;
+            case 1:  what = "SetMinSize"; if(count) s.SetMinSize(i, Size(5 + Random(80), 5 + Random(40))); break;
+            case 2:  what = "SetSpec";    if(count) s.SetSpec(i, RandomSpec()); break;
+            case 3:  what = "Insert";     s.Insert(Random(count + 1), RandomSpec(), 1 + Random(3)); break;
+            case 4:  what = "Remove";     if(count) s.Remove(i, 1 + Random(3)); break;
+            case 5:  what = "Move";       if(count) s.Move(i, Random(count)); break;
+            case 6:  what = "resize";     irc.right = irc.left + 100 + Random(300); break;
+            default: what = "SetCount";   s.SetCount(Random(count + 4)); break;
+            }
+            s.Solve(cfg, irc);
+            Compare(s, cfg, irc, what, run);
+        }
+    }
+
+    Cout() << (failures ? "FAILED" : "OK") << " (" << failures << " mismatches)\n";
+    SetExitCode(failures ? 1 : 0);
+}
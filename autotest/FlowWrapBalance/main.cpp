@@ -0,0 +1,73 @@
+#include <CtrlLib/CtrlLib.h>
+#include <FlowBoxLayout/FlowBoxLayout.h>
+
+using namespace Upp;
+
+// SetWrapBalance keeps the row count of greedy wrapping but spreads
+// the items evenly over the rows. Items are given as letters, 'a'
+// 10 px wide, 'b' 20 px and so on; '|' is AddBreak.
+
+struct Box : Ctrl {
+    int cx;
+
+    Size GetMinSize() const override { return Size(cx, 10); }
+    Box(int cx) : cx(cx) {}
+};
+
+// items per row, as "4+3"
+static String Rows(const char *items, int width, bool balance, int max_items = 1000)
+{
+    FlowBoxLayout fb(FlowBoxLayout::H);
+    fb.SetDeferredLayout(false);
+    fb.SetWrap().SetWrapBalance(balance, max_items);
+    Array<Box> boxes;
+    for(const char *s = items; *s; ++s)
+        if(*s == '|')
+            fb.AddBreak();
+        else
+            fb.AddFit(boxes.Create<Box>(10 * (*s - 'a' + 1)));
+    fb.SetRect(0, 0, width, 300);
+
+    String rows;
+    int top = boxes.GetCount() ? boxes[0].GetRect().top : 0, n = 0;
+    for(Box& b : boxes) {
+        if(b.GetRect().top != top) {
+            rows << n << '+';
+            top = b.GetRect().top;
+            n = 0;
+        }
+        ++n;
+    }
+    return rows << n;
+}
+
+GUI_APP_MAIN
+{
+    static const struct {
+        const char *items;
+        int         width;
+        const char *greedy;
+        const char *balanced;
+    } cases[] = {
+        { "ddddddd",         240, "6+1",     "4+3" },      // the toolbar
+        { "dddddddddd",      240, "6+4",     "5+5" },
+        { "ddddddj",         240, "6+1",     "4+3" },      // the wide one does not fit 5 more
+        { "ddddd",           240, "5",       "5" },        // one row: nothing to balance
+        { "ddddddd|ddddddd", 240, "6+1+6+1", "4+3+4+3" },  // sections balance apart
+        { "dddd|ddddddd",    240, "4+6+1",   "4+4+3" },
+    };
+
+    for(const auto& c : cases) {
+        String greedy = Rows(c.items, c.width, false);
+        String balanced = Rows(c.items, c.width, true);
+        LOG(c.items << " in " << c.width << ": " << greedy << " / " << balanced);
+        ASSERT(greedy == c.greedy);
+        ASSERT(balanced == c.balanced);
+    }
+
+    // sections over max_items stay greedy
+    ASSERT(Rows("ddddddd", 240, true, 6) == "6+1");
+    ASSERT(Rows("ddddddd", 240, true, 7) == "4+3");
+
+    LOG("============ OK");
+}
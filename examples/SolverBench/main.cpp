@@ -0,0 +1,101 @@
+#include <Core/Core.h>
+#include <FlowLayoutSolver/FlowLayoutSolver.h>
+#include <chrono>
+
+using namespace Upp;
+
+// --------------------------------------------------------------
+// Times the expand distribution (the step SetSimd switches) alone
+// and within whole Solve passes, scalar vs vectorized, and checks
+// both give the same rects.
+// --------------------------------------------------------------
+
+static double BestUs(int reps, Event<> fn)
+{
+    double best = 1e30;
+    for(int r = 0; r < reps; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        best = min(best, std::chrono::duration<double, std::micro>(t1 - t0).count());
+    }
+    return best;
+}
+
+static void Fill(FlowLayoutSolver& s, int n)
+{
+    s.Clear();
+    for(int i = 0; i < n; ++i) {
+        FlowItemSpec sp;
+        sp.expandingWeight = 1 + i % 7;
+        sp.min_size = Size(8 + i % 13, 20);
+        if(i % 11 == 0) sp.maxw = 24;          // a few capped items
+        if(i % 17 == 0) sp.minw = 40;
+        s.Add(sp);
+    }
+}
+
+static bool SameCells(const FlowLayoutSolver& a, const FlowLayoutSolver& b)
+{
+    for(int i = 0; i < a.GetCount(); ++i)
+        if(a.GetCell(i).cell != b.GetCell(i).cell || a.GetCell(i).content != b.GetCell(i).content)
+            return false;
+    return true;
+}
+
+static void Report(const char *what, double scalar, double vec)
+{
+    Cout() << Format("%-28s scalar %9.1f us   simd %9.1f us   x%.2f\n",
+                     what, scalar, vec, scalar / max(vec, 0.001));
+}
+
+CONSOLE_APP_MAIN
+{
+    const int N = 20000;
+    const int REPS = 50;
+
+    // Distribution alone, on one packed row
+    Vector<int> size0, weight, lo, hi, size;
+    for(int i = 0; i < N; ++i) {
+        size0.Add(8 + i % 13);
+        weight.Add(1 + i % 7);
+        lo.Add(i % 17 == 0 ? 40 : INT_MIN);
+        hi.Add(i % 11 == 0 ? 24 : INT_MAX);
+    }
+    const int remainder = 40 * N;
+
+    double t[2];
+    Vector<int> out[2];
+    for(int v = 0; v < 2; ++v) {
+        t[v] = BestUs(REPS, [&] {
+            size = clone(size0);
+            FlowLayoutSolver::Distribute(size.begin(), weight.begin(), lo.begin(), hi.begin(),
+                                         N, remainder, v);
+        });
+        out[v] = pick(size);
+    }
+    Report("Distribute (20k items)", t[0], t[1]);
+    bool same = true;
+    for(int i = 0; i < N; ++i)
+        same = same && out[0][i] == out[1][i];
+
+    // Whole passes: one wide H row and one tall V stack
+    for(int d = 0; d < 2; ++d) {
+        FlowLayoutConfig cfg;
+        cfg.dir = d ? FlowLayoutTypes::V : FlowLayoutTypes::H;
+        cfg.gap = 2;
+        const Rect inner = d ? RectC(0, 0, 400, 60 * N) : RectC(0, 0, 60 * N, 400);
+
+        FlowLayoutSolver s[2];
+        for(int v = 0; v < 2; ++v) {
+            Fill(s[v], N);
+            s[v].SetSimd(v);
+            t[v] = BestUs(REPS, [&] { s[v].InvalidateAll(); s[v].Solve(cfg, inner); });
+        }
+        Report(d ? "Solve V stack (20k items)" : "Solve H row (20k items)", t[0], t[1]);
+        same = same && SameCells(s[0], s[1]);
+    }
+
+    Cout() << (same ? "results identical\n" : "RESULTS DIFFER\n");
+    SetExitCode(same ? 0 : 1);
+}